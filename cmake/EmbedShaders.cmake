@@ -0,0 +1,52 @@
+# Writes OUTPUT, a C++ table of every shader in SOURCE_DIR/shaders so they
+# are compiled into the executable (see include/EmbeddedShaders.h).
+# Run with cmake -DSOURCE_DIR=... -DOUTPUT=... -P EmbedShaders.cmake
+
+file(GLOB SHADERS RELATIVE "${SOURCE_DIR}" "${SOURCE_DIR}/shaders/*.vert" "${SOURCE_DIR}/shaders/*.frag")
+list(SORT SHADERS)
+
+set(ARRAYS "")
+set(TABLE "")
+set(INDEX 0)
+foreach(SHADER ${SHADERS})
+    # As bytes, so no string literal length limit or escaping applies
+    file(READ "${SOURCE_DIR}/${SHADER}" HEX HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX}")
+    string(APPEND ARRAYS "const unsigned char shader${INDEX}[] = { ${BYTES}0x00 };\n")
+    string(APPEND TABLE "    { \"${SHADER}\", shader${INDEX} },\n")
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+set(CONTENT "// Generated by cmake/EmbedShaders.cmake from shaders/, do not edit
+#include \"EmbeddedShaders.h\"
+#include <cstring>
+
+namespace {
+
+${ARRAYS}
+struct EmbeddedShader {
+    const char* path;
+    const unsigned char* source;
+};
+
+const EmbeddedShader embeddedShaders[] = {
+${TABLE}    { nullptr, nullptr }
+};
+
+}
+
+const char* FindEmbeddedShader(const char* path) {
+    for (const EmbeddedShader* shader = embeddedShaders; shader->path; shader++) {
+        if (strcmp(shader->path, path) == 0) return (const char*)shader->source;
+    }
+    return nullptr;
+}
+")
+
+# Only touch the file when it changes, so unrelated edits don't rebuild it
+if(EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" OLD_CONTENT)
+endif()
+if(NOT "${OLD_CONTENT}" STREQUAL "${CONTENT}")
+    file(WRITE "${OUTPUT}" "${CONTENT}")
+endif()
@@ -6,6 +6,7 @@
 #include "core.h"
 #include "Tokenizer.h"
 #include "Skeleton.h"
+#include "SkeletonInstance.h"
 
 class Keyframe {
 public:
@@ -24,12 +25,48 @@ public:
     std::string extrapolateOut;
     std::vector<Keyframe> keyframes;
 
-    float Evaluate(float time);
+    // Optional "target <joint> <dof>" from the file (dof is tx/ty/tz/rx/ry/rz).
+    // Empty targetJoint means the channel binds by position in the clip.
+    std::string targetJoint;
+    int targetDof = -1; // 0..2 = translate x/y/z, 3..5 = rotate x/y/z
+
+    // Const and allocation free, so many threads can evaluate one channel
+    float Evaluate(float time) const;
     void Precompute(); // Calculate tangents and coefficients
 
+    // Flattens the precomputed keys for GPU evaluation: appends two texels
+    // per key to keyTable, (time, value, tangentIn, tangentOut) then
+    // (A, B, C, D), and returns (first key, key count, extrapolate in,
+    // extrapolate out) with the rules numbered as in Extrapolation
+    glm::ivec4 Compile(std::vector<glm::vec4>& keyTable) const;
+
 private:
-    float EvaluateSegment(int i, float t);
-    
+    enum Extrapolation { Constant, Linear, Cycle, CycleOffset, Bounce };
+    static Extrapolation ParseExtrapolation(const std::string& rule);
+
+    float EvaluateSegment(int i, float t) const;
+    float Extrapolate(Extrapolation rule, float t) const;
+
+    // Parsed once in Precompute instead of comparing strings per sample
+    Extrapolation extrapIn = Constant;
+    Extrapolation extrapOut = Constant;
+};
+
+// Where each channel of one clip lands in the Pose buffer of one skeleton.
+// Resolved once by Animation::Bind (by joint name where the clip names its
+// targets), so per-frame sampling is a straight indexed scatter.
+class AnimationBinding {
+public:
+    // Float index into Pose::dofs for every channel, -1 when unbound
+    std::vector<int> channelToValue;
+
+    // Channels grouped by the joint they drive, for partial sampling:
+    // joint j owns jointChannels[jointChannelStart[j] .. jointChannelStart[j+1])
+    std::vector<int> rootChannels; // root translation
+    std::vector<int> jointChannelStart;
+    std::vector<int> jointChannels;
+
+    int numUnbound = 0;
 };
 
 class Animation {
@@ -39,6 +76,37 @@ public:
 
     bool Load(const char* filename);
     void Evaluate(float time, Skeleton* skeleton);
+    void Evaluate(float time, SkeletonInstance* skeleton);
+
+    // Resolves every channel against a skeleton: named targets by joint
+    // name, the rest by position (root translation, then 3 rotations per
+    // joint in DFS order). Channels that match nothing are left unbound.
+    void Bind(const SkeletonDefinition& def, AnimationBinding& binding) const;
+
+    // Writes the clip at 'time' into a caller-provided pose buffer. No side
+    // effects and no allocation: safe to call from many threads at once on
+    // a shared Animation. Without a binding the channels are taken to be in
+    // the skeleton's positional layout; extra channels are ignored.
+    void Sample(float time, Pose& pose) const;
+    void Sample(float time, const AnimationBinding& binding, Pose& pose) const;
+
+    // Like Sample, but only evaluates the channels that drive the given
+    // joints and their ancestors (plus the root translation), each joint
+    // once per call however many of the chains share it. Use before
+    // SkeletonInstance::EvaluateJoint when only a few joints are needed.
+    void SampleChains(float time, const AnimationBinding& binding, const SkeletonDefinition& def,
+                      const int* joints, int count, Pose& pose) const;
+
+    // Like Sample, but only the root translation and the given joints'
+    // rotations; other joints keep whatever the pose held (see
+    // SkeletonInstance::UpdateInnerJoints)
+    void SampleJoints(float time, const AnimationBinding& binding, const int* joints, int count, Pose& pose) const;
+    // Just the root translation channels; unbound components are left as
+    // they are
+    void SampleRootTranslation(float time, const AnimationBinding& binding, glm::vec3& translation) const;
+
+    // Every channel's Channel::Compile, in channel order (shaders/animate.vert)
+    void Compile(std::vector<glm::ivec4>& channelTable, std::vector<glm::vec4>& keyTable) const;
 
     float GetStartTime() const { return timeStart; }
     float GetEndTime() const { return timeEnd; }
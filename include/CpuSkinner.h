@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include "core.h"
+#include "Skin.h"
+
+// Structure-of-arrays output of CpuSkinner, owned by the caller so it can be
+// reused every frame without reallocating
+struct SkinnedVertices {
+    std::vector<float> px, py, pz; // skinned positions
+    std::vector<float> nx, ny, nz; // skinned, normalized normals
+
+    void Resize(int numVerts) {
+        px.resize(numVerts); py.resize(numVerts); pz.resize(numVerts);
+        nx.resize(numVerts); ny.resize(numVerts); nz.resize(numVerts);
+    }
+    int GetNumVertices() const { return (int)px.size(); }
+};
+
+// Linear-blend skinning on the CPU, for headless export, collision and
+// server-side use. Prepare copies the bind-pose mesh into SoA arrays once;
+// Deform then skins every vertex against a palette (world * inverse bind,
+// e.g. Skin::GetSkinningMatrices). With AVX2+FMA available at runtime each
+// iteration handles 8 vertices; the vertex range is split across the shared
+// ThreadPool. Each vertex blends exactly its real influences (Skin's sparse
+// weights), so single-influence vertices cost one matrix, not four.
+class CpuSkinner {
+public:
+    CpuSkinner();
+
+    void Prepare(const Skin& skin);
+    int GetNumVertices() const { return numVerts; }
+
+    // Writes into 'out', resizing it only if the vertex count changed.
+    // Normals use the blended 3x3 (exact for rigid and uniformly scaled
+    // bones) and are renormalized.
+    void Deform(const glm::mat4* palette, SkinnedVertices& out) const;
+
+    // Vertices per ThreadPool task; kept a multiple of 8
+    void SetChunkSize(int verts) { chunkSize = (verts + 7) & ~7; }
+
+    static bool HasAvx2(); // runtime CPU check, cached
+
+private:
+    void DeformRange(const float* palette, SkinnedVertices& out, int begin, int end) const;
+    void DeformScalar(const float* palette, SkinnedVertices& out, int begin, int end) const;
+    void DeformAvx2(const float* palette, SkinnedVertices& out, int begin, int end) const;
+
+    int numVerts;
+    int chunkSize;
+
+    // Bind-pose mesh, SoA
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz;
+
+    // Sparse influences, same CSR layout as Skin: vertex v uses entries
+    // [offsets[v], offsets[v+1])
+    std::vector<int> offsets;
+    std::vector<int> bones;
+    std::vector<float> weights;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "core.h"
+#include "Skin.h"
+#include "SkeletonInstance.h"
+#include "Animation.h"
+#include "PaletteBuffer.h"
+#include "VertexAnimationTexture.h"
+#include "GpuAnimator.h"
+#include "Frustum.h"
+
+// Many animated copies of one skin, drawn with instancing. Each character
+// has its own SkeletonInstance and model matrix. Every frame the palettes
+// are packed back to back into one bone buffer (skin.vert finds its own
+// with gl_InstanceID) and the model matrices go into an instance buffer,
+// both ordered by LOD, so the whole crowd costs one draw per LOD and
+// influence range instead of one per character. Characters outside the
+// view frustum are culled first and cost no palette, upload or draw.
+class Crowd {
+public:
+    Crowd(Skin* skin, const SkeletonDefinition* def);
+    ~Crowd();
+
+    // Replaces the crowd with 'count' characters on a square grid in the XZ
+    // plane, centered on the origin and 'spacing' apart. Each one plays the
+    // animation from a different offset so they don't move in lockstep, and
+    // loops it in place: clip times are wrapped into the clip's range for
+    // the skinned, GPU animated and baked paths alike, so root motion never
+    // carries a character off its spot and no path drifts from another.
+    void SpawnGrid(int count, float spacing);
+
+    // Far characters can play a clip baked from the same animation instead:
+    // at LOD fromLod and coarser they are drawn from 'vat' with 'shader'
+    // (shaders/vat.vert) and skip sampling and skeleton updates entirely.
+    // A null vat turns this off.
+    void SetVertexAnimation(const VertexAnimationTexture* vat, GLuint shader, int fromLod);
+
+    // Skinned characters can also be animated on the GPU: Update then does
+    // no CPU work at all and Draw only uploads each character's clip time
+    // before letting 'animator' (loaded with the same clip) write the
+    // palettes. Switches the skin to rigid PaletteAffine3x4, the layout the
+    // animator writes. Levels are picked from the model matrix alone.
+    // A null animator goes back to CPU sampling.
+    void SetGpuAnimator(GpuAnimator* animator);
+
+    // Animation update-rate LOD. Characters nearer than fullRateDistance
+    // (view depth, as of the last Draw) are animated every Update; each
+    // doubling of the distance halves the rate, down to every 8th Update,
+    // and from 8x the distance on only inner joints are posed (leaves stay
+    // at rest, see SkeletonInstance::UpdateInnerJoints). Each character's
+    // turn is offset by its index, so every Update animates about the same
+    // number. In between, characters are drawn with their last pose.
+    // 0 (the default) animates everyone every Update.
+    void SetUpdateRates(float fullRateDistance);
+    // At most this many characters are animated per Update (0 = no limit).
+    // The most overdue relative to their rate go first, so over budget
+    // everyone slows down evenly rather than some freezing.
+    void SetUpdateBudget(int characters) { updateBudget = std::max(characters, 0); }
+
+    // Samples the animation (bind pose if null) and updates the skeletons
+    // whose turn it is (see SetUpdateRates), spread over the shared
+    // ThreadPool. Characters that were culled or drawn from the vertex
+    // animation texture last frame are skipped; Draw catches them up if they
+    // come back into skinned range.
+    void Update(const Animation* animation, const AnimationBinding& binding, float time);
+    // Culls every character against the frustum of viewProjMtx before
+    // anything else. A character with a skeleton is bounded by the posed
+    // bone boxes (Skin::ComputeBounds) of the pose it is drawn with, even
+    // if Update skipped it this time; the others (baked, GPU animated, or
+    // stale after being culled) by a box around the whole clip,
+    // sampled once per animation relative to the root and moved to where
+    // the root is at the character's clip time.
+    void Draw(const glm::mat4& viewProjMtx, const GLuint shaders[Skin::NumInfluenceClasses]);
+
+    // Joint queries for attachments (props, effects, camera follow): the
+    // world matrix of 'joint' of 'character' as it is drawn, call after
+    // Update. A character with a skeleton answers from its world matrices;
+    // baked, GPU animated or culled ones sample only the queried joints'
+    // chains at their clip time (Animation::SampleChains) on a scratch
+    // skeleton, so a few attachment points cost O(depth), not a full pose.
+    void EvaluateJoints(int character, const int* joints, int count, glm::mat4* world);
+    glm::mat4 EvaluateJoint(int character, int joint) {
+        glm::mat4 world;
+        EvaluateJoints(character, &joint, 1, &world);
+        return world;
+    }
+
+    int GetNumInstances() const { return (int)instances.size(); }
+    int GetNumBatches() const { return numBatches; } // instanced draws in the last Draw
+    int GetNumBaked() const { return numBaked; } // drawn from the vertex animation texture
+    int GetNumCulled() const { return numCulled; } // outside the frustum in the last Draw
+    int GetNumAnimated() const { return numAnimated; } // skeletons updated by the last Update
+    int GetNumDeferred() const { return numDeferred; } // due in the last Update but over budget
+
+private:
+    void Animate(int i);
+    float GetClipTime(int i) const;
+    glm::vec3 GetRootTranslation(int i) const; // at GetClipTime(i)
+    void UpdateClipBounds();
+    int SelectUpdateInterval(float distance) const; // 1, 2, 4 or 8
+    void DrawGpuAnimated(const glm::mat4& viewProjMtx, const GLuint shaders[Skin::NumInfluenceClasses], int skinnedLods);
+    bool IsBaked(int level) const { return vat && level >= vatLod; }
+    static const int Culled = -1; // in lodOf
+
+    Skin* skin;
+    const SkeletonDefinition* definition;
+
+    std::vector<SkeletonInstance> instances;
+    std::vector<glm::mat4> models;
+    std::vector<float> phases; // animation offset, fraction of the clip
+    std::vector<int> lastAnimated; // Update count when Animate last ran, far negative if stale
+    std::vector<glm::vec3> poseCenters, poseExtents; // model space bound of that pose
+    SkeletonInstance jointQuery; // scratch for EvaluateJoints
+
+    // From the last Update
+    const Animation* animation;
+    const AnimationBinding* binding;
+    float time;
+
+    const VertexAnimationTexture* vat;
+    GLuint vatShader;
+    int vatLod;
+
+    GpuAnimator* gpuAnimator;
+
+    // Update-rate LOD
+    float fullRateDistance;
+    int updateBudget;
+    int frame; // Updates so far
+    std::vector<unsigned char> updateInterval; // from the last Draw
+    std::vector<unsigned char> innerOnly; // pose only inner joints (very far)
+    std::vector<int> due; // scratch for Update
+    int numAnimated;
+    int numDeferred;
+
+    // Box around every pose of the clip, in model space relative to the
+    // root translation (root motion moves the whole skin), so it follows a
+    // character once offset by GetRootTranslation
+    const Animation* clipBoundsAnimation;
+    bool clipBoundsValid;
+    glm::vec3 clipCenter, clipExtent;
+
+    // Rebuilt every Draw
+    BoundingBoxes bounds; // world space
+    std::vector<unsigned char> visible;
+    std::vector<int> lodOf; // or Culled
+    std::vector<int> lodStart; // first slot in 'order' per level, then the total
+    std::vector<int> cursor; // scratch for the counting sort
+    std::vector<int> order; // instances grouped by LOD
+    std::vector<glm::mat4> drawModels; // models in draw order
+    std::vector<float> drawOffsets; // clip times since the start in draw order (baked only)
+    std::vector<float> drawTimes; // clip times in draw order (GPU animated only)
+    std::vector<glm::mat4> paletteScratch; // numBones per ForEachChunk chunk
+    int numBatches;
+    int numBaked;
+    int numCulled;
+
+    PaletteBuffer paletteBuffer;
+    GLuint instanceBuffer;
+    GLuint offsetBuffer;
+};
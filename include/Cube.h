@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "core.h"
+#include "RenderQueue.h"
 
 class Cube {
 private:
@@ -17,11 +18,15 @@ private:
     std::vector<glm::vec3> normals;
     std::vector<unsigned int> indices;
 
+    static void drawPacket(const RenderQueue::Packet& packet);
+
 public:
     Cube(glm::vec3 cubeMin = glm::vec3(-1, -1, -1), glm::vec3 cubeMax = glm::vec3(1, 1, 1));
     ~Cube();
 
     void draw(const glm::mat4& viewProjMtx, GLuint shader);
+    // queues the same draw; the current model matrix is copied into the packet
+    void submit(RenderQueue& queue, GLuint shader) const;
     void update();
 
     void spin(float deg);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include "core.h"
+#include "SkeletonInstance.h"
+#include "RenderQueue.h"
+
+// Batched joint visualization: boxes, bones (joint to parent) and local
+// axes for every joint of any number of skeletons in one instanced draw.
+// One small line mesh is shared by every joint (a unit box, a bone segment
+// and three axes); each joint is an instance with its world matrix, box
+// extents and parent origin, gathered on the CPU by AddSkeleton and
+// streamed once per Draw. Boxes are lit like Cube, so with only Boxes on
+// the picture matches SkeletonInstance::Draw.
+class DebugDraw {
+public:
+    DebugDraw(); // needs a current context
+    ~DebugDraw();
+
+    enum Part { Boxes = 1, Bones = 2, Axes = 4 };
+    void SetParts(int parts) { this->parts = parts; }
+    int GetParts() const { return parts; }
+
+    // Queues every joint of 'skeleton' (world matrices as of its last
+    // Update), placed by 'model'
+    void AddSkeleton(const SkeletonInstance& skeleton, const glm::mat4& model = glm::mat4(1.0f));
+
+    // Draws everything queued since the last Draw with 'shader'
+    // (shaders/debug.vert + debug.frag), then empties the queue
+    void Draw(const glm::mat4& viewProjMtx, GLuint shader);
+    // Same, as one RenderQueue packet (Debug layer). The instances go up
+    // now, so submit at most once per Execute.
+    void Submit(RenderQueue& queue, GLuint shader);
+
+    int GetNumInstances() const { return (int)instances.size(); }
+
+private:
+    void UploadInstances();
+    static void DrawPacket(const RenderQueue::Packet& packet);
+
+    struct JointInstance {
+        glm::mat4 world;
+        glm::vec4 boxMin, boxMax; // w unused
+        glm::vec4 parentOrigin; // world space; the joint's own for a root
+    };
+    std::vector<JointInstance> instances;
+    int parts;
+
+    GLuint VAO;
+    GLuint VBO, EBO, instanceBuffer;
+    int numIndices;
+};
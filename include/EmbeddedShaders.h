@@ -0,0 +1,7 @@
+#pragma once
+
+// The contents of shaders/ as of the build, compiled into the executable
+// (generated by cmake/EmbedShaders.cmake), so startup doesn't depend on the
+// working directory or read any files. Returns the source for a path like
+// "shaders/skin.vert", or nullptr if it wasn't embedded.
+const char* FindEmbeddedShader(const char* path);
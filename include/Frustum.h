@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include "core.h"
+
+// Axis-aligned boxes as center + half extent, structure-of-arrays so
+// Frustum::Cull can test four at a time
+struct BoundingBoxes {
+    std::vector<float> cx, cy, cz; // centers
+    std::vector<float> ex, ey, ez; // half extents
+
+    void Resize(int count) {
+        cx.resize(count); cy.resize(count); cz.resize(count);
+        ex.resize(count); ey.resize(count); ez.resize(count);
+    }
+    void Set(int i, const glm::vec3& center, const glm::vec3& extent) {
+        cx[i] = center.x; cy[i] = center.y; cz[i] = center.z;
+        ex[i] = extent.x; ey[i] = extent.y; ez[i] = extent.z;
+    }
+    int GetCount() const { return (int)cx.size(); }
+};
+
+// Box around 'm' applied to the box (center, extent): exact for the center,
+// the extent grows by the absolute value of the 3x3 part
+void TransformBox(const glm::mat4& m, const glm::vec3& center, const glm::vec3& extent, glm::vec3& outCenter,
+    glm::vec3& outExtent);
+
+// The six clip planes of a view-projection matrix (Gribb/Hartmann), for
+// culling world-space boxes on the CPU. A box is culled only when it lies
+// entirely behind one plane, so the test is conservative: boxes near a
+// frustum corner can pass while outside.
+class Frustum {
+public:
+    explicit Frustum(const glm::mat4& viewProjMtx);
+
+    bool IsVisible(const glm::vec3& center, const glm::vec3& extent) const;
+    // Writes 1 (visible) or 0 to visible[i] for boxes [begin, end). Four
+    // boxes per iteration with SSE.
+    void Cull(const BoundingBoxes& boxes, int begin, int end, unsigned char* visible) const;
+
+private:
+    glm::vec4 planes[6]; // xyz normal (unnormalized), w distance; inside is >= 0
+};
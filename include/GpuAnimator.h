@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include "core.h"
+#include "Skin.h"
+#include "SkeletonDefinition.h"
+#include "Animation.h"
+
+// Samples one clip and builds skinning palettes entirely on the GPU. Load
+// uploads the clip's compiled keys (Animation::Compile), the rig (parents,
+// offsets, rest pose, limits) and the skin's inverse binds to texture
+// buffers once; after that the CPU only sends one float per character.
+// Evaluate runs shaders/animate.vert over every bone of every character
+// with transform feedback (rasterizer off), writing world * inverseBind
+// straight into a buffer that Bind exposes as the bone texture buffer.
+//
+// The output is a rigid 3x4 palette per character, 3 * numBones texels
+// apart: exactly what Skin reads with PaletteAffine3x4 and SetRigidBones
+// (Euler joints with offsets are rigid anyway). Character i's palette
+// starts at texel i * GetPaletteTexels().
+class GpuAnimator {
+public:
+    GpuAnimator();
+    ~GpuAnimator();
+
+    // Needs a current context. Returns false if the shader does not build.
+    bool Load(const Animation& animation, const AnimationBinding& binding, const SkeletonDefinition& def,
+        const Skin& skin);
+
+    // Palettes for 'count' characters at times[i] (absolute clip time, the
+    // same as Animation::Sample's). count is capped at GetMaxInstances().
+    void Evaluate(const float* times, int count);
+
+    void Bind(GLuint textureUnit) const;
+
+    int GetNumBones() const { return numBones; }
+    int GetPaletteTexels() const { return 3 * numBones; }
+    // Characters one Evaluate can hold (GL_MAX_TEXTURE_BUFFER_SIZE)
+    int GetMaxInstances() const { return maxInstances; }
+
+private:
+    void Destroy();
+    GLuint CreateTextureBuffer(GLuint& buffer, GLenum format, const void* data, size_t size);
+
+    int numBones;
+    int numJoints;
+    int inverseBindBase;
+    glm::ivec3 rootChannels;
+    int capacity; // characters the palette buffer holds
+    int maxInstances;
+
+    GLuint program;
+    GLuint VAO;
+    GLuint timeBuffer;
+
+    // Inputs
+    GLuint keyBuffer, keyTexture;
+    GLuint channelBuffer, channelTexture;
+    GLuint jointBuffer, jointTexture;
+    GLuint jointDataBuffer, jointDataTexture;
+
+    // Transform feedback output, read back as the bone texture buffer
+    GLuint paletteBuffer, paletteTexture;
+};
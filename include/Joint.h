@@ -27,6 +27,12 @@ public:
     
     glm::mat4 GetWorldMatrix () { return WorldMtx;}
 
+    // Rest data accessors (used to flatten the tree into a SkeletonDefinition)
+    const glm::vec3& GetOffset() const { return offset; }
+    const glm::vec3& GetBoxMin() const { return boxmin; }
+    const glm::vec3& GetBoxMax() const { return boxmax; }
+    const glm::vec3& GetPose() const { return pose; }
+
     // Limit accessors
     glm::vec2 GetRotXLimit() const { return rotxlimit; }
     glm::vec2 GetRotYLimit() const { return rotylimit; }
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "core.h"
+
+// Load-time index/vertex reordering for indexed triangle lists. Skinned
+// vertices are expensive (every post-transform cache miss re-runs the bone
+// blend), so meshes are reordered once after loading.
+
+// Average cache miss ratio: vertex shader invocations per triangle for a
+// FIFO post-transform cache of cacheSize entries. 3.0 is the worst case,
+// ~0.5-0.7 is typical for a well ordered mesh.
+float ComputeACMR(const std::vector<unsigned int>& indices, int numVerts, int cacheSize = 16);
+
+// Reorders triangles for post-transform cache locality (Forsyth's linear
+// speed vertex cache optimization). Vertex ids are left unchanged.
+void OptimizeVertexCache(std::vector<unsigned int>& indices, int numVerts);
+
+// Renumbers vertices in first-use order so vertex fetches walk memory
+// forwards. Rewrites 'indices' and fills remap[oldVertex] = newVertex;
+// vertices no triangle uses are moved to the end. Apply remap to every
+// per-vertex array.
+void OptimizeVertexFetch(std::vector<unsigned int>& indices, int numVerts, std::vector<int>& remap);
+
+// Quadric error metric simplification by half-edge collapse: a vertex is
+// only ever merged onto a neighbouring vertex, never moved, so every level
+// of detail can share the original vertex buffer and needs only its own
+// indices. Open borders and seams (vertices sharing a position) are locked,
+// and canCollapse(from, to) can veto any merge (e.g. across skin weight
+// boundaries). Stops at targetTriangles, when the cheapest collapse would
+// move the surface by more than maxError, or when nothing can collapse.
+// Writes the surviving triangles to 'result' and returns the largest
+// collapse error used, as a distance.
+float SimplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+    int targetTriangles, float maxError, const std::function<bool(int, int)>& canCollapse, std::vector<unsigned int>& result);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "core.h"
+
+// Streams skinning palettes to the GPU through a texture buffer, so the
+// shader has no fixed bone limit (GL_MAX_TEXTURE_BUFFER_SIZE is at least
+// 64K texels, i.e. 16K matrices).
+//
+// The buffer is split into numRegions regions used round-robin, one per
+// frame. With ARB_buffer_storage it is mapped once (persistent, coherent)
+// and the CPU writes straight into it; otherwise each write maps its range
+// unsynchronized. A fence after each frame's draws guards its region, so
+// BeginFrame only blocks if the GPU is still numRegions frames behind.
+//
+// Usage per frame:
+//   BeginFrame();
+//   int base; glm::mat4* dst = Allocate(count, base); ...fill...; Commit();
+//   Bind(unit); draw with the shader's boneBase = base
+//   EndFrame();
+class PaletteBuffer {
+public:
+    PaletteBuffer(int numRegions = 3);
+    ~PaletteBuffer();
+
+    void BeginFrame();
+    void EndFrame();
+
+    // Reserves 'count' matrices in this frame's region and returns where to
+    // write them (valid until Commit). baseTexel is the first RGBA32F texel
+    // of the block, 4 texels per matrix. Returns nullptr if count is larger
+    // than the driver allows.
+    glm::mat4* Allocate(int count, int& baseTexel);
+    void Commit();
+
+    // Allocate + copy + Commit; returns baseTexel, or -1 on failure
+    int Upload(const glm::mat4* matrices, int count);
+
+    void Bind(GLuint textureUnit) const;
+
+    int GetRegionCapacity() const { return regionCapacity; }
+    // Largest Allocate the driver's texture buffer size allows, in matrices
+    // (queried on first call, so it needs a current context)
+    int GetMaxCapacity();
+    bool IsPersistent() const { return persistent; }
+
+private:
+    void Create(int capacity);
+    void Destroy();
+    void WaitRegion(int region);
+
+    int numRegions;
+    int regionCapacity; // matrices per region
+    int maxCapacity;
+    int region;
+    int cursor; // matrices used in the current region
+
+    bool persistent;
+    glm::mat4* mapped; // whole buffer when persistent, else the pending range
+    bool pendingUnmap;
+
+    GLuint buffer;
+    GLuint texture;
+    GLsync fences[8];
+};
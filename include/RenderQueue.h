@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "core.h"
+
+// Deferred draws for one pass, sorted to change as little state as
+// possible. Instead of drawing, objects Submit packets: the program and
+// vertex array they need plus whatever their draw function reads. Execute
+// sorts the packets by 64-bit key and runs them in that order, binding a
+// program or vertex array only when it differs from the previous packet's
+// and never unbinding in between. viewProj is uploaded once per program;
+// everything else (per-draw uniforms, textures, the draw call) is up to the
+// packet's draw function, which must not bind programs or vertex arrays.
+//
+// Key, most significant bits first:
+//   4 layer | 16 program | 16 vertex array | 28 depth
+// so layers run in order, each program's packets run together, each vertex
+// array's run together within those, and then front to back. Packets with
+// equal keys keep their submission order.
+class RenderQueue {
+public:
+    enum Layer { Opaque, Debug };
+
+    struct Packet;
+    typedef void (*DrawFunc)(const Packet& packet);
+
+    struct Packet {
+        GLuint program = 0;
+        GLuint vertexArray = 0;
+        DrawFunc draw = nullptr;
+        const void* object = nullptr; // whatever 'draw' needs, usually the submitter
+        glm::ivec4 args = glm::ivec4(0); // per-draw integers (level, range, bone base...)
+        glm::mat4 model = glm::mat4(1.0f);
+    };
+
+    // 'depth' is any non-negative distance from the camera (e.g. clip w)
+    static uint64_t MakeKey(int layer, GLuint program, GLuint vertexArray, float depth = 0.0f);
+
+    void SetViewProj(const glm::mat4& viewProjMtx) { viewProj = viewProjMtx; }
+    const glm::mat4& GetViewProj() const { return viewProj; }
+
+    void Submit(uint64_t key, const Packet& packet);
+    // Runs after every packet of this Execute was drawn, e.g. to fence a
+    // streamed buffer the packets read
+    typedef void (*Callback)(void* object);
+    void OnExecuted(Callback callback, void* object);
+
+    // Draws everything submitted since the last Execute, then empties the queue
+    void Execute();
+    int GetNumPackets() const { return (int)packets.size(); }
+
+    // Binds in the last Execute, and what the same packets would have
+    // needed in submission order
+    struct Stats {
+        int packets = 0;
+        int programChanges = 0, vertexArrayChanges = 0;
+        int unsortedProgramChanges = 0, unsortedVertexArrayChanges = 0;
+    };
+    const Stats& GetStats() const { return stats; }
+
+private:
+    glm::mat4 viewProj = glm::mat4(1.0f);
+    std::vector<Packet> packets;
+    std::vector<std::pair<uint64_t, int>> order; // key, packet
+    std::vector<std::pair<Callback, void*>> callbacks;
+    Stats stats;
+};
@@ -10,4 +10,32 @@
 
 #include "core.h"
 
-GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path);
+// Sources come from the copies embedded at build time (EmbeddedShaders.h),
+// or from disk for paths that weren't embedded. 'defines' (e.g.
+// "#define MAX_INFLUENCES 2\n") is inserted into every stage right after
+// its #version line, for compiling shader variants.
+//
+// Linked programs are cached with glGetProgramBinary in shadercache/,
+// keyed by a hash of the sources, defines, varyings and driver strings,
+// so a warm start loads them without compiling anything.
+//
+// Building is split in two so the driver can work on every program at
+// once: the Request calls start compiling and linking (or load the cached
+// binary) and return the program name without waiting, and FinishShaders
+// checks them all and reflects the linked ones (ShaderProgram::Get).
+// Names are only usable once FinishShaders returned true; a failed program
+// is left unlinked, for the caller to delete like any other.
+GLuint RequestShaders(const char* vertex_file_path, const char* fragment_file_path, const char* defines = nullptr);
+
+// Vertex shader only, linked to capture 'varyings' with transform feedback
+// (interleaved into one buffer); for GPU compute passes under GL 3.3
+GLuint RequestTransformFeedbackShader(const char* vertex_file_path, const char* const* varyings, int numVaryings,
+    const char* defines = nullptr);
+
+// False if any program requested since the last call failed
+bool FinishShaders();
+
+// Request + FinishShaders for a single program; 0 if it failed
+GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path, const char* defines = nullptr);
+GLuint LoadTransformFeedbackShader(const char* vertex_file_path, const char* const* varyings, int numVaryings,
+    const char* defines = nullptr);
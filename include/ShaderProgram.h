@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "core.h"
+
+// A linked program's interface, reflected once right after linking
+// (LoadShaders and LoadTransformFeedbackShader do it): every active uniform
+// and uniform block, sorted by name, plus the locations of the uniforms the
+// renderer sets on every draw in a table indexed by Uniform. Draws then
+// never look a uniform up by string in the driver.
+//
+// Programs stay plain GLuints everywhere; Get finds the reflection by name.
+class ShaderProgram {
+public:
+    // Set on (almost) every draw; -1 where the program doesn't use it
+    enum Uniform { ViewProj, Model, DiffuseColor, BoneMatrices, BoneBase, NormalBase, BoneFormat, InstanceStride,
+                   NumUniforms };
+
+    struct UniformInfo {
+        std::string name; // arrays without the "[0]"
+        GLint location; // -1 for block members
+        GLenum type;
+        GLint size;
+    };
+    struct BlockInfo {
+        std::string name;
+        GLuint index;
+        GLint dataSize;
+    };
+
+    // Reflects a freshly linked program, replacing whatever had its name before
+    static const ShaderProgram& Reflect(GLuint program);
+    // The reflection of 'program'; an empty one (every location -1) if it
+    // was never reflected
+    static const ShaderProgram& Get(GLuint program);
+
+    GLuint GetID() const { return id; }
+    GLint GetLocation(Uniform uniform) const { return locations[uniform]; }
+    // Any active uniform, from the reflected table; -1 if there is none
+    GLint FindLocation(const char* name) const;
+    const std::vector<UniformInfo>& GetUniforms() const { return uniforms; }
+    const std::vector<BlockInfo>& GetBlocks() const { return blocks; }
+
+    // Binds the program unless it already is (BoundState::UseProgram)
+    void Use() const;
+
+    ShaderProgram();
+
+private:
+    GLuint id;
+    GLint locations[NumUniforms];
+    std::vector<UniformInfo> uniforms;
+    std::vector<BlockInfo> blocks;
+};
+
+// The program and vertex array last bound through here, so repeated binds
+// of the same object are skipped. Every bind in the renderer goes through
+// it; code that binds either one directly (or a library that doesn't
+// restore them afterwards) has to call Reset.
+class BoundState {
+public:
+    static void UseProgram(GLuint program);
+    static void BindVertexArray(GLuint vao);
+    // glDeleteVertexArrays that also forgets the VAO if it was bound (GL
+    // unbinds it, and a new one may get the same name); zeroes 'vao'
+    static void DeleteVertexArray(GLuint& vao);
+    static void Reset(); // state unknown: the next binds always go to GL
+
+    // Binds that reached GL, and those skipped as redundant
+    struct Stats {
+        int programBinds = 0, programSkips = 0;
+        int vertexArrayBinds = 0, vertexArraySkips = 0;
+    };
+    static const Stats& GetStats() { return stats; }
+    static void ResetStats() { stats = Stats(); }
+
+private:
+    static GLuint program;
+    static GLuint vertexArray;
+    static Stats stats;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "core.h"
+#include "Cube.h"
+#include "Skeleton.h"
+
+// Read-only description of a rig: hierarchy, offsets, limits and box geometry.
+// Joints are stored flat in DFS order (the same order as Skeleton::jointList),
+// so a joint's parent always comes before it. Any number of SkeletonInstances
+// can share one definition; only the instances hold pose data.
+class SkeletonDefinition {
+public:
+    SkeletonDefinition();
+    ~SkeletonDefinition();
+
+    // Owns GL geometry, so it is not copyable
+    SkeletonDefinition(const SkeletonDefinition&) = delete;
+    SkeletonDefinition& operator=(const SkeletonDefinition&) = delete;
+
+    // createGeometry = false skips the joint boxes (no GL context needed)
+    bool Load(const char* filename, bool createGeometry = true);
+    void Build(Skeleton& skeleton, bool createGeometry = true);
+
+    int GetNumJoints() const { return (int)parents.size(); }
+    int GetParent(int j) const { return parents[j]; }
+    const std::vector<int>& GetChildren(int j) const { return children[j]; }
+    const std::string& GetName(int j) const { return names[j]; }
+    int FindJoint(const std::string& name) const; // -1 if there is no such joint
+    int GetDepth(int j) const { return depths[j]; } // root is 0
+
+    // Descendants of j are exactly the joints in [j + 1, GetSubtreeEnd(j))
+    int GetSubtreeEnd(int j) const { return subtreeEnd[j]; }
+
+    // Update schedule for the parallel world-matrix pass: the spine joints
+    // (in DFS order) are updated first on one thread, then every task range
+    // is an independent subtree that only depends on already-updated spine
+    // joints, so the ranges can run on any thread in any order.
+    const std::vector<int>& GetUpdateSpine() const { return updateSpine; }
+    const std::vector<glm::ivec2>& GetUpdateTasks() const { return updateTasks; }
+
+    // Joints with children (plus the root), in DFS order, and every joint's
+    // local matrix at its rest pose: for animation LOD that poses only the
+    // inner joints and keeps the leaves at rest
+    const std::vector<int>& GetInnerJoints() const { return innerJoints; }
+    const glm::mat4& GetRestLocalMatrix(int j) const { return restLocal[j]; }
+
+    const glm::vec3& GetOffset(int j) const { return offsets[j]; }
+    const glm::vec3& GetBoxMin(int j) const { return boxMin[j]; }
+    const glm::vec3& GetBoxMax(int j) const { return boxMax[j]; }
+    const glm::vec3& GetRestPose(int j) const { return restPose[j]; }
+
+    // Limits packed per axis: x/y/z of min and max
+    const glm::vec3& GetLimitMin(int j) const { return limitMin[j]; }
+    const glm::vec3& GetLimitMax(int j) const { return limitMax[j]; }
+
+    Cube* GetGeometry(int j) const { return geometry.empty() ? nullptr : geometry[j]; }
+
+    // Same local matrix as Joint::Update: Translate(offset) * RotZ * RotY * RotX,
+    // with the euler angles clamped to the joint limits
+    glm::mat4 ComputeLocalMatrix(int j, const glm::vec3& offset, const glm::vec3& pose) const;
+
+private:
+    void Clear();
+    void BuildUpdateSchedule();
+
+    // Hierarchy
+    std::vector<int> parents; // -1 for the root
+    std::vector<std::vector<int>> children;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> nameToIndex;
+    std::vector<int> depths;
+    std::vector<int> subtreeEnd;
+
+    // Parallel update schedule
+    std::vector<int> updateSpine;
+    std::vector<glm::ivec2> updateTasks; // [begin, end) joint ranges
+    std::vector<int> innerJoints;
+
+    // Rest data
+    std::vector<glm::vec3> offsets;
+    std::vector<glm::vec3> boxMin;
+    std::vector<glm::vec3> boxMax;
+    std::vector<glm::vec3> restPose;
+    std::vector<glm::vec3> limitMin;
+    std::vector<glm::vec3> limitMax;
+    std::vector<glm::mat4> restLocal;
+
+    // One box per joint, shared by every instance
+    std::vector<Cube*> geometry;
+};
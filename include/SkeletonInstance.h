@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include "core.h"
+#include "SkeletonDefinition.h"
+
+// Pose buffer in the same layout as the .anim channels: slot 0 holds the root
+// translation, slot j+1 holds the euler angles (radians) of joint j.
+struct Pose {
+    std::vector<glm::vec3> dofs;
+
+    // Scratch for Animation::SampleChains: joint j was sampled by the
+    // current call when chainStamp[j] == sampleStamp. Lives here so the
+    // shared Animation stays const and nothing is allocated per call.
+    std::vector<unsigned int> chainStamp;
+    unsigned int sampleStamp = 0;
+
+    void Resize(int numJoints) { dofs.resize(numJoints + 1); chainStamp.resize(numJoints, 0); }
+    int GetNumJoints() const { return (int)dofs.size() - 1; }
+
+    glm::vec3& RootTranslation() { return dofs[0]; }
+    const glm::vec3& RootTranslation() const { return dofs[0]; }
+    glm::vec3& Rotation(int j) { return dofs[j + 1]; }
+    const glm::vec3& Rotation(int j) const { return dofs[j + 1]; }
+};
+
+// One character on a shared SkeletonDefinition. Holds only the pose and the
+// resulting world matrices; everything else is read through the definition.
+class SkeletonInstance {
+public:
+    SkeletonInstance(const SkeletonDefinition* def);
+
+    void ResetPose();
+    void Update(); // Computes world matrices from the pose
+    // Cheaper Update for distant characters: only the definition's inner
+    // joints use the pose; leaves follow their parent at their rest pose
+    void UpdateInnerJoints();
+    void Draw(const glm::mat4& viewProjMtx, GLuint shader);
+
+    // Rigs with at least this many joints are updated on the shared
+    // ThreadPool; smaller ones use the plain serial loop
+    void SetParallelThreshold(int numJoints) { parallelThreshold = numJoints; }
+    int GetParallelThreshold() const { return parallelThreshold; }
+
+    const SkeletonDefinition* GetDefinition() const { return definition; }
+    int GetNumJoints() const { return definition->GetNumJoints(); }
+
+    // Non-const pose access assumes the pose is about to change and drops
+    // the cached joint queries. Call MarkPoseChanged if you keep a pointer
+    // and write through it later.
+    Pose& GetPose() { MarkPoseChanged(); return pose; }
+    const Pose& GetPose() const { return pose; }
+    void MarkPoseChanged() { poseVersion++; }
+
+    // Pointer to a joint's euler angles so ImGui can modify them directly
+    float* GetPosePtr(int j) { MarkPoseChanged(); return &pose.Rotation(j)[0]; }
+
+    // World matrices as of the last Update (or EvaluateJoint for that joint)
+    const glm::mat4& GetWorldMatrix(int j) const { return worldMtx[j]; }
+    const std::vector<glm::mat4>& GetWorldMatrices() const { return worldMtx; }
+
+    // Single-joint queries (attachments, IK targets, camera follow): only
+    // the ancestor chain of the joint is computed, O(depth) instead of a full
+    // Update. Results are cached until the pose changes, so queries that
+    // share ancestors only pay for the part of the chain not yet computed.
+    const glm::mat4& EvaluateJoint(int j);
+    void EvaluateJoints(const int* joints, int count);
+
+private:
+    void UpdateJoint(int j);
+    void UpdateRange(int begin, int end);
+    void UpdateParallel();
+
+    const SkeletonDefinition* definition;
+    int parallelThreshold = 4096;
+    Pose pose;
+    std::vector<glm::mat4> worldMtx; // Indexed like the definition (DFS order)
+
+    // worldMtx[j] is current when worldVersion[j] == poseVersion
+    unsigned int poseVersion = 1;
+    std::vector<unsigned int> worldVersion;
+    std::vector<int> chainScratch; // Reused by EvaluateJoint, no per-query allocation
+};
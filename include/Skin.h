@@ -5,35 +5,199 @@
 #include <GL/glew.h>
 #include "Tokenizer.h"
 #include "Skeleton.h"
+#include "SkeletonInstance.h"
+#include "PaletteBuffer.h"
+#include "RenderQueue.h"
+
+class ShaderProgram;
 
 class Skin {
 public:
     Skin();
     ~Skin();
 
+    // Influences kept per vertex (largest weights first); set before Load
+    void SetMaxInfluences(int count) { maxInfluences = count < 1 ? 1 : count; }
+    int GetMaxInfluences() const { return maxInfluences; }
+
     bool Load(const char* filename);
     void Update(Skeleton* skeleton); // Computes bone matrices
-    void Draw(const glm::mat4& viewProjMtx, GLuint shader);
+    void Update(SkeletonInstance* skeleton);
+    // Vertices are drawn in ranges by influence count (1, 2, 4, 8), one
+    // shader variant per range (skin.vert with MAX_INFLUENCES defined).
+    // There is no single-program Draw: the 8-influence range's weights are
+    // quantized over all 8 slots, so a 4-influence program would shrink it.
+    static const int NumInfluenceClasses = 4;
+    void Draw(const glm::mat4& viewProjMtx, const GLuint shaders[NumInfluenceClasses]);
+    // Same picture through a RenderQueue: uploads the palette now and queues
+    // one packet per influence range, at the level the queue's viewProj
+    // picks. At most once per frame, like Draw.
+    void Submit(RenderQueue& queue, const GLuint shaders[NumInfluenceClasses]);
+
+    // For rigs whose bones are rigid or uniformly scaled: normals then use
+    // the skin matrix directly instead of per-bone normal matrices (which
+    // are computed on the CPU and uploaded with the palette). Load turns it
+    // on when every bind matrix is rigid or uniformly scaled, since the
+    // skeletons here only rotate and offset joints; turn it off for a pose
+    // source that scales bones non-uniformly.
+    void SetRigidBones(bool rigid);
+    bool GetRigidBones() const { return rigidBones; }
+
+    // How the palette is encoded in the bone buffer. Affine3x4 (the default)
+    // is exact for any skinning matrix: 48 bytes a bone with rigid bones, 96
+    // with the normal matrices alongside. DualQuaternion
+    // (32 bytes) keeps only rotation + translation, so it is for rigid rigs;
+    // the shader blends it as dual quaternions rather than matrices.
+    enum PaletteFormat { PaletteMatrix4x4, PaletteAffine3x4, PaletteDualQuaternion };
+    void SetPaletteFormat(PaletteFormat format);
+    PaletteFormat GetPaletteFormat() const { return paletteFormat; }
+
+    // Instanced drawing (see Crowd). A packed palette is GetPaletteTexels()
+    // RGBA32F texels; PackPalette encodes one from skinning matrices in the
+    // current format. SelectLod picks a level from the skinning matrix of
+    // bone 0, model transform included.
+    int GetPaletteTexels() const;
+    void PackPalette(const glm::mat4* matrices, glm::vec4* out) const;
+    int SelectLod(const glm::mat4& viewProjMtx, const glm::mat4& rootMtx) const;
+    // Draws 'count' instances of one level. Instance i reads its palette at
+    // boneBase + i * GetPaletteTexels() from the bone texture bound to unit
+    // 0, and its model matrix from mat4 element firstInstance + i of
+    // instanceBuffer.
+    void DrawInstanced(const glm::mat4& viewProjMtx, const GLuint shaders[NumInfluenceClasses], int level,
+        int boneBase, GLuint instanceBuffer, int firstInstance, int count);
+
+    // Transform feedback skinning (see SkinnedVertexCache): runs every
+    // vertex once as a point through its influence range's variant, with
+    // the programs linked to capture FragPos and FragNormal, so
+    // outputBuffer receives the skinned mesh in vertex order as vec3
+    // position + vec3 normal (GetNumVertices() * 24 bytes). The copy is
+    // drawn with this skin's index buffer and DrawIndexed.
+    void SkinVertices(const GLuint shaders[NumInfluenceClasses], GLuint outputBuffer);
+    // Draws one level's triangles from whatever vertex arrays are bound
+    void DrawIndexed(int level) const;
+    GLuint GetIndexBuffer() const { return EBO; }
+    // The level Draw would use from this view: forced, or by projected size
+    int GetDrawLod(const glm::mat4& viewProjMtx) const;
+    // Bumped whenever Update (or a format change) packs a different palette
+    unsigned int GetPaletteVersion() const { return paletteVersion; }
+
+    // Read access for CPU-side consumers (e.g. CpuSkinner)
+    int GetNumVertices() const { return (int)positions.size(); }
+    int GetNumBones() const { return (int)bindings.size(); }
+    const std::vector<glm::vec3>& GetPositions() const { return positions; }
+    const std::vector<glm::vec3>& GetNormals() const { return normals; }
+    const std::vector<unsigned char>& GetVertexData() const { return vertexData; }
+    int GetVertexStride() const { return vertexStride; }
+
+    // Sparse (CSR) weights: vertex v's influences are entries
+    // [influenceOffsets[v], influenceOffsets[v+1]) of influenceJoints /
+    // influenceWeights, sorted by descending weight and normalized
+    const std::vector<int>& GetInfluenceOffsets() const { return influenceOffsets; }
+    const std::vector<int>& GetInfluenceJoints() const { return influenceJoints; }
+    const std::vector<float>& GetInfluenceWeights() const { return influenceWeights; }
+    const std::vector<glm::mat4>& GetSkinningMatrices() const { return skinningMatrices; }
+    const std::vector<glm::mat4>& GetInverseBindings() const { return inverseBindings; }
+
+    // Levels of detail, generated at load. Draw picks one from the skin's
+    // projected size unless a level is forced (-1 = automatic).
+    int GetNumLods() const { return (int)lods.size(); }
+    int GetLodTriangles(int level) const { return (int)lods[level].indices.size() / 3; }
+    const std::vector<unsigned int>& GetLodIndices(int level) const { return lods[level].indices; }
+    int GetCurrentLod() const { return currentLod; }
+    float GetBoundRadius() const { return boundRadius; }
+
+    // Culling bounds. Each bone keeps a box (in its own joint space) around
+    // the bind-pose vertices it influences, so the union of those boxes
+    // posed by the joint world matrices contains every skinned vertex.
+    // ComputeBounds returns that union as center + half extent; joints past
+    // 'count' stay at their bind pose. Draw and Submit skip the palette
+    // upload and the draw when the box from the last Update is off-screen.
+    void ComputeBounds(const glm::mat4* world, int count, glm::vec3& center, glm::vec3& extent) const;
+    bool IsCulled(const glm::mat4& viewProjMtx) const;
+    void SetForcedLod(int level) { forcedLod = level; }
 
 private:
+    struct LodLevel {
+        int firstIndex; // into the EBO
+        std::vector<unsigned int> indices; // grouped by influence class
+        int classStart[NumInfluenceClasses + 1]; // into indices
+        int classMinVertex[NumInfluenceClasses], classMaxVertex[NumInfluenceClasses];
+        float error; // largest collapse distance
+    };
+
+    void OptimizeMesh(); // cache/fetch reordering, run once at load
+    void RemapVertices(const std::vector<int>& remap);
+    int GetInfluenceClass(int v) const;
+    void BuildLods();
+    void BuildBoneBoxes();
+    bool HasRigidBindings() const;
+    // worldBound from joint world matrices (bind pose past 'count')
+    void UpdateBounds(const glm::mat4* world, int count);
+    void PartitionTriangles(LodLevel& lod) const;
+    void PartitionVertices();
+    bool SimilarWeights(int a, int b) const;
+    int SelectLod(const glm::mat4& viewProjMtx) const;
+    void BuildVertexData();
+    int GetBoneTexels() const;
+    int GetNormalTexelOffset() const; // -1 without normal matrices
+    void PackPalette(); // skinningMatrices -> paletteTexels
+    int UploadPalette(); // returns boneBase, or -1
+    void SetSkinningUniforms(GLuint shader, const glm::mat4& viewProjMtx, int boneBase) const;
+    void SetPaletteUniforms(const ShaderProgram& program, int boneBase) const; // all but viewProj
+    void DrawClass(int level, int c, int instanceCount) const; // one influence range of a level
+    static void DrawPacket(const RenderQueue::Packet& packet);
+    static void EndPaletteFrame(void* skin);
+    void DrawLod(const glm::mat4& viewProjMtx, const GLuint shaders[NumInfluenceClasses], int level,
+        int boneBase, int instanceCount);
+
     // CPU Data
     std::vector<glm::vec3> positions;
     std::vector<glm::vec3> normals;
-    std::vector<glm::mat4> bindings; // Inverse bind matrices
-    std::vector<unsigned int> indices;
-
-    // GPU-friendly Skin Weights
-    // We limit to 4 weights per vertex for the shader
-    struct VertexBoneData {
-        glm::vec4 weights;
-        glm::ivec4 ids; 
+    std::vector<glm::mat4> bindings; // Bind pose (joint world) matrices from the file
+    std::vector<glm::mat4> inverseBindings; // Inverted once at load
+    std::vector<unsigned int> indices; // full detail
+
+    std::vector<LodLevel> lods; // lods[0] is the full mesh
+    int forcedLod;
+    int currentLod;
+    glm::vec3 boundCenter;
+    float boundRadius;
+
+    struct BoneBox {
+        int bone;
+        glm::vec3 center, extent; // joint space
     };
-    std::vector<VertexBoneData> skinWeights;
+    std::vector<BoneBox> boneBoxes; // bones without vertices have none
+    glm::vec3 worldBoundCenter, worldBoundExtent; // posed by the last Update
+
+    int maxInfluences;
+    std::vector<int> influenceOffsets; // numVerts + 1
+    std::vector<int> influenceJoints;
+    std::vector<float> influenceWeights;
+
+    // Packed, interleaved GPU vertices (see BuildVertexData)
+    std::vector<unsigned char> vertexData;
+    int vertexStride;
+    GLenum boneIndexType;
+    std::vector<unsigned char> extraVertexData; // influences 5-8
+    int extraVertexStride;
+    int numExtraVertices;
+    // Vertices are grouped by the widest influence class that uses them,
+    // 8 first: class c's vertices are [classFirstVertex[c], classEndVertex[c])
+    int classFirstVertex[NumInfluenceClasses], classEndVertex[NumInfluenceClasses];
 
     // Matrices to send to GPU
     std::vector<glm::mat4> skinningMatrices;
+    std::vector<glm::vec4> paletteTexels; // encoded bones, then normal matrices
+    std::vector<glm::vec4> packScratch;
+    std::vector<glm::mat4> jointWorldScratch; // Update(Skeleton*) gathers the Joint tree here
+    unsigned int paletteVersion;
+    PaletteFormat paletteFormat;
+    PaletteBuffer paletteBuffer;
+    bool rigidBones;
 
     // GL buffers
     GLuint VAO;
-    GLuint VBO_pos, VBO_norm, VBO_weights, VBO_ids, EBO;
+    GLuint VBO, VBO_extra, EBO;
+    GLenum indexType; // GL_UNSIGNED_SHORT when the vertex count allows
 };
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "core.h"
+
+// Skinning palette builder: palette[i] = world[i] * inverseBind[i] for every
+// joint, in one pass over contiguous arrays (e.g. straight from
+// SkeletonInstance::GetWorldMatrices). Uses SSE when the target has it.
+void BuildSkinPalette(const glm::mat4* world, const glm::mat4* inverseBind, int count, glm::mat4* palette);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include "core.h"
+#include "Skin.h"
+
+// Skins a Skin once per frame into a vertex buffer with transform feedback
+// (skin.vert, capturing its world position and normal), so every pass that
+// draws the same posed character afterwards (main view, thumbnails,
+// picking...) reads the finished vertices through shaders/skinned.vert
+// instead of blending bones again. Update skips the skinning entirely when
+// the skin's palette hasn't changed since the last one, e.g. while the
+// animation is paused.
+class SkinnedVertexCache {
+public:
+    SkinnedVertexCache();
+    ~SkinnedVertexCache();
+
+    // Builds the capture programs and the output buffer; needs a current
+    // context and a loaded skin
+    bool Create(Skin* skin);
+    bool IsCreated() const { return VAO != 0; }
+
+    // Call after Skin::Update. Returns true if it skinned, false if the
+    // cached vertices were still current.
+    bool Update();
+
+    // One pass over the cached vertices, at the level Skin::Draw would pick.
+    // 'shader' is shaders/skinned.vert with any fragment shader.
+    void Draw(const glm::mat4& viewProjMtx, GLuint shader);
+    // The same pass as one RenderQueue packet
+    void Submit(RenderQueue& queue, GLuint shader) const;
+
+    int GetNumSkinned() const { return numSkinned; } // Updates that did skin
+
+    // Tolerance check for the compact palettes: skins the skin's current
+    // pose once with 'format' (and rigid bones on or off) and once with the
+    // full PaletteMatrix4x4 + normal matrices path, and returns the largest
+    // position difference (as a fraction of the bound radius) and normal
+    // difference. Leaves the skin's format as it was and the cache invalid.
+    void ComparePaletteFormat(Skin::PaletteFormat format, bool rigid, float& positionError, float& normalError);
+
+private:
+    void Destroy();
+    void ReadBack(std::vector<glm::vec3>& vertices) const; // position, normal pairs
+    static void DrawPacket(const RenderQueue::Packet& packet);
+
+    Skin* skin;
+    GLuint programs[Skin::NumInfluenceClasses];
+    GLuint buffer;
+    GLuint VAO;
+
+    bool valid;
+    unsigned int version; // skin palette the buffer holds
+    int numSkinned;
+};
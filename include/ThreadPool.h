@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Minimal fork/join pool. ParallelFor hands out indices dynamically to the
+// workers and the calling thread, and returns once every index is done.
+class ThreadPool {
+public:
+    // numThreads counts the calling thread; 0 picks hardware_concurrency
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int GetNumThreads() const { return (int)workers.size() + 1; }
+
+    // Runs fn(i) for every i in [0, count). Not reentrant: do not call
+    // ParallelFor from inside fn.
+    void ParallelFor(int count, const std::function<void(int)>& fn);
+
+    // Process-wide pool shared by the animation and skinning code
+    static ThreadPool& Get();
+
+private:
+    void WorkerLoop();
+    void RunJob(const std::function<void(int)>& fn, int count);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    // Current job
+    const std::function<void(int)>* job = nullptr;
+    int jobCount = 0;
+    std::atomic<int> nextIndex{0};
+    int generation = 0;
+    int finishedWorkers = 0; // every worker checks in once per generation
+    bool quit = false;
+};
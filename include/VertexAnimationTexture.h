@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include "core.h"
+#include "Skin.h"
+#include "SkeletonDefinition.h"
+#include "Animation.h"
+
+// A clip baked to skinned vertices, for characters too far away to be
+// worth a skeleton. Bake runs the animation, skeleton and CPU skinner at a
+// fixed frame rate and stores every frame's positions and normals in one
+// RGBA32UI texture: xyz are the position's float bits, w the normal as
+// 10-10-10-2 snorm, so playback (shaders/vat.vert) is a single texelFetch
+// per vertex and no CPU animation work at all. Frames are stored back to
+// back, frame f's vertex v at texel f * numVertices + v, wrapped into rows.
+//
+// The skin's LOD index lists are copied too, so a level can be drawn
+// instanced with per-instance model matrices and clip time offsets.
+class VertexAnimationTexture {
+public:
+    VertexAnimationTexture();
+    ~VertexAnimationTexture();
+
+    // Needs a current context. Skinning is linear blend, as in skin.vert.
+    bool Bake(const Skin& skin, const SkeletonDefinition& def, const Animation& animation,
+        const AnimationBinding& binding, float frameRate);
+
+    // Draws 'count' instances of one level. Instance i takes its model
+    // matrix from mat4 element firstInstance + i of modelBuffer and its time
+    // offset (seconds) from float element firstInstance + i of offsetBuffer;
+    // 'time' is relative to the clip start. Playback loops the clip.
+    void DrawInstanced(const glm::mat4& viewProjMtx, GLuint shader, int level, float time,
+        GLuint modelBuffer, GLuint offsetBuffer, int firstInstance, int count) const;
+
+    int GetNumFrames() const { return numFrames; }
+    float GetFrameRate() const { return frameRate; }
+    float GetDuration() const { return numFrames / frameRate; }
+    int GetNumLods() const { return (int)lodFirstIndex.size(); }
+
+private:
+    int numVertices;
+    int numFrames;
+    float frameRate;
+
+    std::vector<int> lodFirstIndex, lodIndexCount;
+
+    GLuint texture;
+    GLuint VAO, EBO;
+    GLenum indexType; // GL_UNSIGNED_SHORT when the vertex count allows
+};
@@ -3,10 +3,16 @@
 #include "Camera.h"
 #include "Cube.h"
 #include "Skeleton.h"
+#include "SkeletonDefinition.h"
+#include "SkeletonInstance.h"
 #include "Shader.h"
 #include "skin.h"
 #include "skin.h"
 #include "Animation.h"
+#include "Crowd.h"
+#include "SkinnedVertexCache.h"
+#include "DebugDraw.h"
+#include "RenderQueue.h"
 #include "core.h"
 
 class Window {
@@ -18,15 +24,30 @@ public:
 
     // Objects to render
     static Cube* cube;
-    static Skeleton* skeleton;
+    static DebugDraw* debugDraw; // joint boxes/bones/axes, one draw per frame
+    static SkeletonDefinition* skeletonDef; // shared rig data
+    static SkeletonInstance* skeleton;      // pose of the character on screen
     static Skin* skin;
+    static SkinnedVertexCache* skinCache; // skin skinned once per pose, see skinnedShaderProgram
+    static bool useSkinCache; // draw the skin through skinCache (only pays off with several passes)
+    static Crowd* crowd;  // instanced copies of the skin, see crowdSize
+    static int crowdSize; // characters to spawn on a grid, 0 = just the one
+    static VertexAnimationTexture* crowdClip; // baked animation for far crowd members
+    static GpuAnimator* crowdAnimator; // samples the clip on the GPU, see gpuAnimation
+    static bool gpuAnimation; // animate the skinned crowd members on the GPU
+    static bool crowdUpdateLod; // animate far crowd members less often (Crowd::SetUpdateRates)
+    static RenderQueue renderQueue; // everything but the crowd, sorted by program/VAO
 
     // Shader Program
     static GLuint shaderProgram;
-    static GLuint skinShaderProgram;
+    static GLuint skinShaderPrograms[Skin::NumInfluenceClasses]; // 1/2/4/8 influence variants
+    static GLuint vatShaderProgram; // vertex animation texture playback
+    static GLuint skinnedShaderProgram; // draws skinCache's pre-skinned vertices
+    static GLuint debugShaderProgram; // DebugDraw
     
 
     static Animation* animation;
+    static AnimationBinding animationBinding; // animation -> skeleton channel map
     static float time;
     static bool isPlaying;
 
@@ -38,6 +59,15 @@ public:
     static void cleanUp();
 
     static void LoadSkeleton(const char* filename);
+    static void BindAnimation(); // call whenever the skeleton or animation changes
+    // --check-palette: compares every compact bone palette against the 4x4
+    // one at a few poses of the loaded clip; true if all are within tolerance
+    static bool CheckPaletteFormats();
+    // --bench-palette: times building skinning matrices the old way
+    // (world * glm::inverse(bind) per joint) against BuildSkinPalette with
+    // the cached inverses, on random 1k and 10k joint rigs; needs no files
+    // or context. True if both give the same matrices.
+    static bool BenchPalette();
 
     // for the Window
     static GLFWwindow* createWindow(int width, int height);
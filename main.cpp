@@ -46,6 +46,11 @@ void print_versions() {
 }
 
 int main(int argc, char** argv) {
+    // "--bench-palette" only times the skinning matrix builder, no window
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--bench-palette") exit(Window::BenchPalette() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
     // Create the GLFW window.
     GLFWwindow* window = Window::createWindow(800, 600);
     
@@ -80,26 +85,37 @@ int main(int argc, char** argv) {
     // Initialize objects/pointers for rendering; exit if initialization fails.
     if (!Window::initializeObjects()) exit(EXIT_FAILURE);
 
-    // Load skeleton
-    const char* skeleton_name = nullptr;
-    const char* skin_name = nullptr;
-    if (argc == 2) { // only skeleton provided
-        skeleton_name = argv[1];
-        Window::LoadSkeleton(skeleton_name);
+    // Load skeleton, skin and animation (any order, picked by extension).
+    // "--crowd N" draws N animated copies of the skin on a grid instead;
+    // "--gpu-animation" samples their clip on the GPU; "--skin-cache" draws
+    // the single character through a SkinnedVertexCache; "--check-palette"
+    // runs the bone palette tolerance check and exits.
+    bool checkPalette = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--crowd" && i + 1 < argc) {
+            Window::crowdSize = atoi(argv[++i]);
+        }
+        else if (arg == "--gpu-animation") {
+            Window::gpuAnimation = true;
+        }
+        else if (arg == "--skin-cache") {
+            Window::useSkinCache = true;
+        }
+        else if (arg == "--check-palette") {
+            checkPalette = true;
+        }
+        else {
+            Window::LoadSkeleton(argv[i]);
+        }
     }
-    else if (argc == 3) {
-        skeleton_name = argv[1];
-        skin_name = argv[2];
-        Window::LoadSkeleton(skeleton_name);
-        Window::LoadSkeleton(skin_name);
-    }
-    else if (argc == 4) {
-        skeleton_name = argv[1];
-        skin_name = argv[2];
-        const char* anim_name = argv[3];
-        Window::LoadSkeleton(skeleton_name);
-        Window::LoadSkeleton(skin_name);
-        Window::LoadSkeleton(anim_name);
+
+    if (checkPalette) {
+        bool passed = Window::CheckPaletteFormats();
+        Window::cleanUp();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(passed ? EXIT_SUCCESS : EXIT_FAILURE);
     }
 
     // Loop while GLFW window should stay open.
@@ -0,0 +1,136 @@
+#version 330 core
+
+// Animation sampling and skeleton update on the GPU, for GpuAnimator. Drawn
+// as points with rasterization off: one vertex per bone (gl_VertexID) per
+// character (gl_InstanceID). Each vertex evaluates the channels of its bone
+// and all its ancestors, builds the world matrix and captures
+// world * inverseBind with transform feedback as 3 rows, so the output
+// buffer is a rigid 3x4 bone palette per character, ready for skin.vert.
+
+// Clip time for this character
+layout(location = 0) in float in_Time;
+
+// Channel::Compile: two texels per key, (time, value, tangentIn, tangentOut)
+// and (A, B, C, D). Per channel (first key, key count, extrapolate in, out).
+uniform samplerBuffer keys;
+uniform isamplerBuffer channels;
+
+// Per joint (rx, ry, rz channel or -1, parent) and 4 float texels: offset,
+// rest pose, limit min, limit max. Inverse bind rows (3 texels per bone)
+// follow the joint data from inverseBindBase.
+uniform isamplerBuffer joints;
+uniform samplerBuffer jointData;
+uniform int numJoints;
+uniform int inverseBindBase;
+
+// Root translation channels, -1 where the root keeps its offset
+uniform ivec3 rootChannels;
+
+out vec4 PaletteRow0;
+out vec4 PaletteRow1;
+out vec4 PaletteRow2;
+
+// Channel::Extrapolation
+const int Constant = 0;
+const int Linear = 1;
+const int Cycle = 2;
+const int CycleOffset = 3;
+const int Bounce = 4;
+
+float EvaluateChannel(int c, float t, float unbound) {
+    if (c < 0) return unbound;
+    ivec4 ch = texelFetch(channels, c);
+    if (ch.y == 0) return 0.0;
+    vec4 first = texelFetch(keys, 2 * ch.x);
+    if (ch.y == 1) return first.y;
+    int lastKey = ch.x + ch.y - 1;
+    vec4 last = texelFetch(keys, 2 * lastKey);
+
+    // Same rules as Channel::Extrapolate, but the cycles wrap t into range
+    // instead of recursing
+    float offset = 0.0;
+    if (t < first.x || t > last.x) {
+        bool before = t < first.x;
+        int rule = before ? ch.z : ch.w;
+        if (rule == Linear) {
+            return before ? first.y + first.z * (t - first.x) : last.y + last.w * (t - last.x);
+        }
+        if (rule != Cycle && rule != CycleOffset && rule != Bounce) {
+            return before ? first.y : last.y;
+        }
+        float duration = last.x - first.x;
+        float cycles = floor((t - first.x) / duration);
+        float wrapped = t - first.x - cycles * duration;
+        if (rule == Bounce && mod(cycles, 2.0) != 0.0) {
+            t = last.x - wrapped;
+        } else {
+            t = first.x + wrapped;
+        }
+        if (rule == CycleOffset) offset = (last.y - first.y) * cycles;
+        t = clamp(t, first.x, last.x);
+    }
+
+    // Binary search for the last key at or before t
+    int lo = ch.x;
+    int hi = lastKey - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (texelFetch(keys, 2 * mid).x <= t) lo = mid;
+        else hi = mid - 1;
+    }
+    float t0 = texelFetch(keys, 2 * lo).x;
+    float t1 = texelFetch(keys, 2 * lo + 2).x;
+    vec4 coeffs = texelFetch(keys, 2 * lo + 1);
+    float u = (t - t0) / (t1 - t0);
+    return ((coeffs.x * u + coeffs.y) * u + coeffs.z) * u + coeffs.w + offset;
+}
+
+// SkeletonDefinition::ComputeLocalMatrix: Translate(offset) * RotZ * RotY * RotX
+mat4 LocalMatrix(int j, float t) {
+    ivec4 joint = texelFetch(joints, j);
+    vec3 offset = texelFetch(jointData, 4 * j).xyz;
+    vec3 rest = texelFetch(jointData, 4 * j + 1).xyz;
+    vec3 pose = vec3(EvaluateChannel(joint.x, t, rest.x),
+                     EvaluateChannel(joint.y, t, rest.y),
+                     EvaluateChannel(joint.z, t, rest.z));
+    pose = clamp(pose, texelFetch(jointData, 4 * j + 2).xyz, texelFetch(jointData, 4 * j + 3).xyz);
+    if (joint.w < 0) {
+        offset = vec3(EvaluateChannel(rootChannels.x, t, offset.x),
+                      EvaluateChannel(rootChannels.y, t, offset.y),
+                      EvaluateChannel(rootChannels.z, t, offset.z));
+    }
+
+    vec3 c = cos(pose), s = sin(pose);
+    mat3 rx = mat3(1.0, 0.0, 0.0, 0.0, c.x, s.x, 0.0, -s.x, c.x);
+    mat3 ry = mat3(c.y, 0.0, -s.y, 0.0, 1.0, 0.0, s.y, 0.0, c.y);
+    mat3 rz = mat3(c.z, s.z, 0.0, -s.z, c.z, 0.0, 0.0, 0.0, 1.0);
+    mat3 r = rz * ry * rx;
+    return mat4(vec4(r[0], 0.0), vec4(r[1], 0.0), vec4(r[2], 0.0), vec4(offset, 1.0));
+}
+
+void main() {
+    int bone = gl_VertexID;
+    mat4 palette = mat4(1.0);
+
+    // Bones past the skeleton keep the identity, as in Crowd's palettes
+    if (bone < numJoints) {
+        // Walk up to the root; parents always have lower indices
+        mat4 world = LocalMatrix(bone, in_Time);
+        for (int j = texelFetch(joints, bone).w; j >= 0; j = texelFetch(joints, j).w) {
+            world = LocalMatrix(j, in_Time) * world;
+        }
+
+        int texel = inverseBindBase + 3 * bone;
+        mat4 inverseBind = transpose(mat4(texelFetch(jointData, texel),
+                                          texelFetch(jointData, texel + 1),
+                                          texelFetch(jointData, texel + 2),
+                                          vec4(0.0, 0.0, 0.0, 1.0)));
+        palette = world * inverseBind;
+    }
+
+    // Rows of the top 3x4, as Skin::PackPalette writes PaletteAffine3x4
+    mat4 rows = transpose(palette);
+    PaletteRow0 = rows[0];
+    PaletteRow1 = rows[1];
+    PaletteRow2 = rows[2];
+}
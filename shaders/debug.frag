@@ -0,0 +1,22 @@
+#version 330 core
+
+in vec3 fragNormal;
+in vec3 fragColor;
+in float fragLit;
+
+// Same lighting as shader.frag for the lit parts
+uniform vec3 AmbientColor = vec3(0.2);
+uniform vec3 LightDirection = normalize(vec3(1, 5, 2));
+uniform vec3 LightColor = vec3(1);
+
+out vec4 color;
+
+void main()
+{
+    if (fragLit > 0.5) {
+        vec3 irradiance = AmbientColor + LightColor * max(0, dot(LightDirection, fragNormal));
+        color = vec4(sqrt(irradiance * fragColor), 1);
+    } else {
+        color = vec4(fragColor, 1);
+    }
+}
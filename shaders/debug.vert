@@ -0,0 +1,53 @@
+#version 330 core
+
+// Joint boxes, bones and axes for DebugDraw: one shared line mesh, one
+// instance per joint.
+
+// Shared mesh: unit box corner or segment endpoint, box face normal, and
+// which part the vertex belongs to (0 box, 1 bone, 2/3/4 x/y/z axis)
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in float part;
+
+// Per joint
+layout(location = 3) in mat4 in_World;
+layout(location = 7) in vec3 in_BoxMin;
+layout(location = 8) in vec3 in_BoxMax;
+layout(location = 9) in vec3 in_ParentOrigin;
+
+uniform mat4 viewProj;
+uniform int parts; // DebugDraw::Part bits
+
+out vec3 fragNormal;
+out vec3 fragColor;
+out float fragLit; // 1 for the boxes, which are shaded like shader.frag
+
+void main()
+{
+    int p = int(part + 0.5);
+    vec4 worldPos;
+    fragNormal = vec3(0.0);
+    fragLit = 0.0;
+    if (p == 0) {
+        worldPos = in_World * vec4(mix(in_BoxMin, in_BoxMax, position), 1.0);
+        fragNormal = vec3(in_World * vec4(normal, 0));
+        fragColor = vec3(1.0);
+        fragLit = 1.0;
+    } else if (p == 1) {
+        worldPos = vec4(mix(in_World[3].xyz, in_ParentOrigin, position.x), 1.0);
+        fragColor = vec3(1.0, 0.85, 0.2);
+    } else {
+        // Scaled by the box's middle extent, so long thin bones don't get
+        // huge axes
+        vec3 size = abs(in_BoxMax - in_BoxMin);
+        float median = size.x + size.y + size.z - max(max(size.x, size.y), size.z) - min(min(size.x, size.y), size.z);
+        float len = 0.75 * median;
+        worldPos = in_World * vec4(position * len, 1.0);
+        fragColor = vec3(equal(ivec3(p), ivec3(2, 3, 4)));
+    }
+    gl_Position = viewProj * worldPos;
+
+    // Parts that are switched off go outside the clip volume
+    int bit = p == 0 ? 1 : (p == 1 ? 2 : 4);
+    if ((parts & bit) == 0) gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+}
@@ -1,45 +1,150 @@
 #version 330 core
 
+// Influences blended per vertex: 1, 2, 4 or 8. Skin draws each influence
+// count range with its own variant (LoadShaders defines this).
+#ifndef MAX_INFLUENCES
+#define MAX_INFLUENCES 4
+#endif
+
 // Input vertex data
+// Packed by Skin::BuildVertexData: the normal is 10-10-10-2 snorm and the
+// weights unorm8, both expanded to floats by the attribute fetch
 layout(location = 0) in vec3 in_Position;
-layout(location = 1) in vec3 in_Normal;
-// Maximum 4 bone influences per vertex is standard
+layout(location = 1) in vec4 in_Normal;
+// The 4 largest bone influences (unused ones have weight 0)
 layout(location = 2) in vec4 in_BoneWeights;
-layout(location = 3) in ivec4 in_BoneIndices;
+layout(location = 3) in uvec4 in_BoneIndices;
+#if MAX_INFLUENCES > 4
+// Influences 5-8
+layout(location = 4) in vec4 in_BoneWeights2;
+layout(location = 5) in uvec4 in_BoneIndices2;
+#endif
+// Per-instance model matrix (locations 6-9) for instanced crowds; identity
+// for a single skin
+layout(location = 6) in mat4 in_InstanceModel;
 
 
 // Uniforms
 uniform mat4 viewProj;
 uniform mat4 model; // usually Identity for the skin itself
 
-// Array of matrices: (WorldMatrix * InverseBindMatrix) for every joint
-const int MAX_BONES = 100;
-uniform mat4 boneMatrices[MAX_BONES];
+// Matrices (WorldMatrix * InverseBindMatrix) for every joint, stored in a
+// texture buffer from texel boneBase, so there is no fixed bone limit.
+// boneFormat is Skin::PaletteFormat: 0 = mat4 as 4 RGBA32F texels
+// (columns), 1 = 3x4 affine as 3 texels (rows), 2 = dual quaternion as 2
+// texels (rotation, then dual part).
+uniform samplerBuffer boneMatrices;
+uniform int boneBase;
+uniform int boneFormat;
+
+// Instanced draws pack one palette per instance, instanceStride texels
+// apart; this instance's palette starts paletteOffset texels in
+uniform int instanceStride;
+int paletteOffset = 0;
+
+mat4 GetBoneMatrix(uint bone) {
+    if (boneFormat == 1) {
+        int texel = boneBase + paletteOffset + int(bone) * 3;
+        return transpose(mat4(texelFetch(boneMatrices, texel),
+                              texelFetch(boneMatrices, texel + 1),
+                              texelFetch(boneMatrices, texel + 2),
+                              vec4(0.0, 0.0, 0.0, 1.0)));
+    }
+    int texel = boneBase + paletteOffset + int(bone) * 4;
+    return mat4(texelFetch(boneMatrices, texel),
+                texelFetch(boneMatrices, texel + 1),
+                texelFetch(boneMatrices, texel + 2),
+                texelFetch(boneMatrices, texel + 3));
+}
+
+// Rigid transform from a blended (unnormalized) dual quaternion
+mat4 DualQuaternionToMatrix(vec4 real, vec4 dual) {
+    float len = length(real);
+    real /= len;
+    dual /= len;
+    vec3 t = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+
+    float x = real.x, y = real.y, z = real.z, w = real.w;
+    return mat4(1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y + w * z), 2.0 * (x * z - w * y), 0.0,
+                2.0 * (x * y - w * z), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z + w * x), 0.0,
+                2.0 * (x * z + w * y), 2.0 * (y * z - w * x), 1.0 - 2.0 * (x * x + y * y), 0.0,
+                t, 1.0);
+}
+
+// Per-bone normal matrices (inverse transpose of the bone's 3x3), built on
+// the CPU with the palette, 3 texels each from normalBase. -1 when the rig
+// is flagged rigid/uniformly scaled or uses dual quaternions: the skin
+// matrix's own 3x3 is then already a valid normal transform (up to length).
+uniform int normalBase;
+
+mat3 GetNormalMatrix(uint bone) {
+    int texel = normalBase + paletteOffset + int(bone) * 3;
+    return mat3(texelFetch(boneMatrices, texel).xyz,
+                texelFetch(boneMatrices, texel + 1).xyz,
+                texelFetch(boneMatrices, texel + 2).xyz);
+}
+
+mat4 skinMatrix;
+mat3 normalMatrix;
+vec4 dqReal = vec4(0.0), dqDual = vec4(0.0);
+
+void AddInfluence(uint bone, float weight) {
+    if (boneFormat == 2) {
+        int texel = boneBase + paletteOffset + int(bone) * 2;
+        vec4 real = texelFetch(boneMatrices, texel);
+        // q and -q are the same rotation: blend on the first bone's side
+        if (dot(real, dqReal) < 0.0) weight = -weight;
+        dqReal += weight * real;
+        dqDual += weight * texelFetch(boneMatrices, texel + 1);
+        return;
+    }
+    skinMatrix += weight * GetBoneMatrix(bone);
+    if (normalBase >= 0) normalMatrix += weight * GetNormalMatrix(bone);
+}
 
 // Outputs to Fragment Shader
 out vec3 FragPos;
 out vec3 FragNormal;
 
 void main() {
+    paletteOffset = gl_InstanceID * instanceStride;
+    mat4 world = model * in_InstanceModel;
+
     // 1. Calculate Skinning Matrix
-    // Sum of (Weight * BoneMatrix)
-    mat4 skinMatrix = 
-        in_BoneWeights.x * boneMatrices[in_BoneIndices.x] +
-        in_BoneWeights.y * boneMatrices[in_BoneIndices.y] +
-        in_BoneWeights.z * boneMatrices[in_BoneIndices.z] +
-        in_BoneWeights.w * boneMatrices[in_BoneIndices.w];
+    // Sum of (Weight * BoneMatrix), and the same for the normal matrices
+    skinMatrix = mat4(0.0);
+    normalMatrix = mat3(0.0);
+#if MAX_INFLUENCES == 1
+    // Rigidly bound: no blend at all
+    AddInfluence(in_BoneIndices.x, 1.0);
+#else
+    AddInfluence(in_BoneIndices.x, in_BoneWeights.x);
+    AddInfluence(in_BoneIndices.y, in_BoneWeights.y);
+#if MAX_INFLUENCES > 2
+    AddInfluence(in_BoneIndices.z, in_BoneWeights.z);
+    AddInfluence(in_BoneIndices.w, in_BoneWeights.w);
+#endif
+#if MAX_INFLUENCES > 4
+    AddInfluence(in_BoneIndices2.x, in_BoneWeights2.x);
+    AddInfluence(in_BoneIndices2.y, in_BoneWeights2.y);
+    AddInfluence(in_BoneIndices2.z, in_BoneWeights2.z);
+    AddInfluence(in_BoneIndices2.w, in_BoneWeights2.w);
+#endif
+#endif
+    if (boneFormat == 2) skinMatrix = DualQuaternionToMatrix(dqReal, dqDual);
+    if (normalBase < 0) normalMatrix = mat3(skinMatrix);
 
     // 2. Transform Position
     // Apply skin matrix first (local deformation), then viewProj
     vec4 skinnedPos = skinMatrix * vec4(in_Position, 1.0);
-    gl_Position = viewProj * model * skinnedPos;
+    gl_Position = viewProj * world * skinnedPos;
     
     // Pass world position to fragment shader
-    FragPos = vec3(model * skinnedPos);
+    FragPos = vec3(world * skinnedPos);
 
     // 3. Transform Normal
-    // Normals must use the inverse transpose of the transformation matrix
-    mat3 normalMatrix = transpose(inverse(mat3(skinMatrix)));
-    vec3 worldNormal = mat3(model) * normalMatrix * in_Normal;
+    // Normals must use the inverse transpose of the transformation matrix;
+    // blending the bones' precomputed ones avoids a 3x3 inverse per vertex
+    vec3 worldNormal = mat3(world) * normalMatrix * in_Normal.xyz;
     FragNormal = normalize(worldNormal);
 }
\ No newline at end of file
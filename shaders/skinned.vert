@@ -0,0 +1,19 @@
+#version 330 core
+
+// Draws a skin that SkinnedVertexCache has already skinned this frame:
+// positions and normals are in world space, so this is only the projection.
+
+layout(location = 0) in vec3 in_Position;
+layout(location = 1) in vec3 in_Normal;
+
+uniform mat4 viewProj;
+
+// Outputs to Fragment Shader
+out vec3 FragPos;
+out vec3 FragNormal;
+
+void main() {
+    gl_Position = viewProj * vec4(in_Position, 1.0);
+    FragPos = in_Position;
+    FragNormal = in_Normal;
+}
@@ -0,0 +1,40 @@
+#version 330 core
+
+// Playback of a clip baked by VertexAnimationTexture: no skeleton and no
+// vertex arrays, just one texel per vertex per frame (xyz = position bits,
+// w = 10-10-10-2 snorm normal), found through gl_VertexID.
+
+// Per-instance model matrix and clip time offset (seconds)
+layout(location = 6) in mat4 in_InstanceModel;
+layout(location = 10) in float in_TimeOffset;
+
+uniform mat4 viewProj;
+
+uniform usampler2D vatTexture;
+uniform int numVertices;
+uniform int numFrames;
+uniform float frameRate;
+uniform float time; // since the clip start
+
+// Outputs to Fragment Shader
+out vec3 FragPos;
+out vec3 FragNormal;
+
+vec3 UnpackNormal(uint bits) {
+    // Shift each 10-bit field to the top, then sign extend back down
+    ivec3 v = ivec3(uvec3(bits << 22u, bits << 12u, bits << 2u)) >> 22;
+    return vec3(v) / 511.0;
+}
+
+void main() {
+    // Nearest baked frame, looping
+    int frame = int(mod(floor((time + in_TimeOffset) * frameRate), float(numFrames)));
+    int texel = frame * numVertices + gl_VertexID;
+    int width = textureSize(vatTexture, 0).x;
+    uvec4 data = texelFetch(vatTexture, ivec2(texel % width, texel / width), 0);
+
+    vec4 worldPos = in_InstanceModel * vec4(uintBitsToFloat(data.xyz), 1.0);
+    gl_Position = viewProj * worldPos;
+    FragPos = vec3(worldPos);
+    FragNormal = normalize(mat3(in_InstanceModel) * UnpackNormal(data.w));
+}
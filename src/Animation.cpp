@@ -93,6 +93,18 @@ bool Animation::Load(const char* filename) {
                     }
                     tokenizer.FindToken("}");
                 }
+                else if (strcmp(token, "target") == 0) {
+                    tokenizer.GetToken(token); ch.targetJoint = token;
+                    tokenizer.GetToken(token);
+                    const char* dofNames[] = {"tx", "ty", "tz", "rx", "ry", "rz"};
+                    for (int d = 0; d < 6; d++) {
+                        if (strcmp(token, dofNames[d]) == 0) ch.targetDof = d;
+                    }
+                    if (ch.targetDof < 0) {
+                        printf("Warning: unknown dof '%s' for target %s\n", token, ch.targetJoint.c_str());
+                        ch.targetJoint.clear();
+                    }
+                }
             }
             ch.Precompute();
             channels.push_back(ch);
@@ -127,10 +139,10 @@ void Animation::Evaluate(float time, Skeleton* skeleton) {
     int channelIdx = 3;
     if (root) {
         // Use a helper function to traverse DFS and apply rotations
-        std::vector<Joint*> joints = skeleton->jointList;
+        const std::vector<Joint*>& joints = skeleton->jointList;
         
         for (Joint* j : joints) {
-            if (channelIdx + 3 > channels.size()) break;
+            if (channelIdx + 3 > (int)channels.size()) break;
             
             float rx = channels[channelIdx++].Evaluate(time);
             float ry = channels[channelIdx++].Evaluate(time);
@@ -141,115 +153,239 @@ void Animation::Evaluate(float time, Skeleton* skeleton) {
     }
 }
 
+void Animation::Evaluate(float time, SkeletonInstance* skeleton) {
+    if (!skeleton) return;
+    Sample(time, skeleton->GetPose());
+}
+
+void Animation::Sample(float time, Pose& pose) const {
+    if (channels.size() < 3) return;
+
+    // The pose buffer uses the channel layout directly: slot 0 is the root
+    // translation, slot j+1 the rotation of joint j
+    size_t numValues = std::min(channels.size(), pose.dofs.size() * 3) / 3 * 3;
+    float* values = &pose.dofs[0][0];
+    for (size_t i = 0; i < numValues; i++) {
+        values[i] = channels[i].Evaluate(time);
+    }
+}
+
+void Animation::Bind(const SkeletonDefinition& def, AnimationBinding& binding) const {
+    int numJoints = def.GetNumJoints();
+    int numChannels = (int)channels.size();
+
+    binding.channelToValue.assign(numChannels, -1);
+    binding.numUnbound = 0;
+
+    std::vector<int> channelJoint(numChannels, -1); // -1 = unbound, -2 = root translation
+    for (int i = 0; i < numChannels; i++) {
+        const Channel& ch = channels[i];
+        int joint, dof;
+        if (!ch.targetJoint.empty()) {
+            joint = def.FindJoint(ch.targetJoint);
+            dof = ch.targetDof;
+        } else {
+            // Positional layout
+            joint = i < 3 ? 0 : (i - 3) / 3;
+            dof = i < 3 ? i : 3 + (i - 3) % 3;
+        }
+
+        if (joint < 0 || joint >= numJoints) {
+            binding.numUnbound++;
+            continue;
+        }
+        if (dof < 3) {
+            // The pose only has a translation for the root
+            if (joint != 0) {
+                binding.numUnbound++;
+                continue;
+            }
+            binding.channelToValue[i] = dof;
+            channelJoint[i] = -2;
+        } else {
+            binding.channelToValue[i] = 3 * (joint + 1) + (dof - 3);
+            channelJoint[i] = joint;
+        }
+    }
+
+    // Group the bound channels by joint
+    binding.rootChannels.clear();
+    binding.jointChannelStart.assign(numJoints + 1, 0);
+    for (int i = 0; i < numChannels; i++) {
+        if (channelJoint[i] == -2) binding.rootChannels.push_back(i);
+        else if (channelJoint[i] >= 0) binding.jointChannelStart[channelJoint[i] + 1]++;
+    }
+    for (int j = 0; j < numJoints; j++) {
+        binding.jointChannelStart[j + 1] += binding.jointChannelStart[j];
+    }
+    binding.jointChannels.resize(binding.jointChannelStart[numJoints]);
+    std::vector<int> fill(binding.jointChannelStart.begin(), binding.jointChannelStart.end() - 1);
+    for (int i = 0; i < numChannels; i++) {
+        if (channelJoint[i] >= 0) binding.jointChannels[fill[channelJoint[i]]++] = i;
+    }
+
+    if (binding.numUnbound > 0) {
+        printf("Warning: %d of %d animation channels did not bind to the skeleton\n", binding.numUnbound, numChannels);
+    }
+}
+
+void Animation::Sample(float time, const AnimationBinding& binding, Pose& pose) const {
+    float* values = &pose.dofs[0][0];
+    int numChannels = (int)std::min(channels.size(), binding.channelToValue.size());
+    for (int i = 0; i < numChannels; i++) {
+        int slot = binding.channelToValue[i];
+        if (slot >= 0) values[slot] = channels[i].Evaluate(time);
+    }
+}
+
+void Animation::SampleChains(float time, const AnimationBinding& binding, const SkeletonDefinition& def,
+                             const int* joints, int count, Pose& pose) const {
+    float* values = &pose.dofs[0][0];
+    for (int i : binding.rootChannels) {
+        values[binding.channelToValue[i]] = channels[i].Evaluate(time);
+    }
+
+    // Rotations of each chain, walking up until a joint an earlier chain of
+    // this call already sampled: its ancestors are done too, so a spine
+    // shared by k queries is evaluated once, not k times
+    int numJoints = def.GetNumJoints();
+    if ((int)pose.chainStamp.size() < numJoints) pose.chainStamp.resize(numJoints, 0);
+    if (++pose.sampleStamp == 0) {
+        std::fill(pose.chainStamp.begin(), pose.chainStamp.end(), 0);
+        pose.sampleStamp = 1;
+    }
+    for (int q = 0; q < count; q++) {
+        for (int j = joints[q]; j >= 0 && pose.chainStamp[j] != pose.sampleStamp; j = def.GetParent(j)) {
+            pose.chainStamp[j] = pose.sampleStamp;
+            for (int k = binding.jointChannelStart[j]; k < binding.jointChannelStart[j + 1]; k++) {
+                int i = binding.jointChannels[k];
+                values[binding.channelToValue[i]] = channels[i].Evaluate(time);
+            }
+        }
+    }
+}
+
+void Animation::SampleJoints(float time, const AnimationBinding& binding, const int* joints, int count,
+                             Pose& pose) const {
+    float* values = &pose.dofs[0][0];
+    for (int i : binding.rootChannels) {
+        values[binding.channelToValue[i]] = channels[i].Evaluate(time);
+    }
+    for (int q = 0; q < count; q++) {
+        int j = joints[q];
+        for (int k = binding.jointChannelStart[j]; k < binding.jointChannelStart[j + 1]; k++) {
+            int i = binding.jointChannels[k];
+            values[binding.channelToValue[i]] = channels[i].Evaluate(time);
+        }
+    }
+}
+
+void Animation::SampleRootTranslation(float time, const AnimationBinding& binding, glm::vec3& translation) const {
+    for (int i : binding.rootChannels) {
+        translation[binding.channelToValue[i]] = channels[i].Evaluate(time);
+    }
+}
+
+void Animation::Compile(std::vector<glm::ivec4>& channelTable, std::vector<glm::vec4>& keyTable) const {
+    channelTable.clear();
+    keyTable.clear();
+    for (const Channel& ch : channels) {
+        channelTable.push_back(ch.Compile(keyTable));
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Channel
 ////////////////////////////////////////////////////////////////////////////////
 
-float Channel::Evaluate(float time) {
+Channel::Extrapolation Channel::ParseExtrapolation(const std::string& rule) {
+    if (rule == "linear") return Linear;
+    if (rule == "cycle") return Cycle;
+    if (rule == "cycle_offset") return CycleOffset;
+    if (rule == "bounce") return Bounce;
+    return Constant; // Default constant
+}
+
+float Channel::Evaluate(float time) const {
     if (keyframes.empty()) return 0.0f;
     if (keyframes.size() == 1) return keyframes[0].value;
 
     // Handle time range and extrapolation
     float t = time;
-    float firstTime = keyframes.front().time;
-    float lastTime = keyframes.back().time;
+    if (t < keyframes.front().time) return Extrapolate(extrapIn, t);
+    if (t > keyframes.back().time) return Extrapolate(extrapOut, t);
+
+    // Find segment: last key with key.time <= t
+    auto it = std::upper_bound(keyframes.begin(), keyframes.end(), t,
+        [](float value, const Keyframe& key) { return value < key.time; });
+    int i = (int)(it - keyframes.begin()) - 1;
+    i = std::max(0, std::min(i, (int)keyframes.size() - 2));
+    return EvaluateSegment(i, t);
+}
+
+float Channel::Extrapolate(Extrapolation rule, float t) const {
+    const Keyframe& first = keyframes.front();
+    const Keyframe& last = keyframes.back();
+    float firstTime = first.time;
+    float lastTime = last.time;
     float duration = lastTime - firstTime;
+    bool before = t < firstTime;
 
-    if (t < firstTime) {
-        if (extrapolateIn == "constant") return keyframes.front().value;
-        else if (extrapolateIn == "linear") {
-             float slope = keyframes.front().tangentInValue;
-             // slope is tangent (value/time).
-             // If extrapolated linearly backwards:
-             return keyframes.front().value + slope * (t - firstTime);
-        }
-        else if (extrapolateIn == "cycle") {
-             float wrappedT = fmod(t - firstTime, duration);
-             if (wrappedT < 0) wrappedT += duration;
-             return Evaluate(firstTime + wrappedT);
+    switch (rule) {
+        case Linear:
+            // slope is tangent (value/time), continued from the end we left
+            if (before) return first.value + first.tangentInValue * (t - firstTime);
+            return last.value + last.tangentOutValue * (t - lastTime);
+        case Cycle: {
+            float wrappedT = fmod(t - firstTime, duration);
+            if (wrappedT < 0) wrappedT += duration;
+            return Evaluate(firstTime + wrappedT);
         }
-        else if (extrapolateIn == "cycle_offset") {
-             float cycleCount = floor((t - firstTime) / duration);
-             float wrappedT = t - firstTime - cycleCount * duration;
-             float offset = (keyframes.back().value - keyframes.front().value) * cycleCount;
-             return Evaluate(firstTime + wrappedT) + offset;
+        case CycleOffset: {
+            float cycleCount = floor((t - firstTime) / duration);
+            float wrappedT = t - firstTime - cycleCount * duration;
+            float offset = (last.value - first.value) * cycleCount;
+            return Evaluate(firstTime + wrappedT) + offset;
         }
-        else if (extrapolateIn == "bounce") {
-             float cycleCount = floor((t - firstTime) / duration);
-             float wrappedT = t - firstTime - cycleCount * duration;
-             if ((int)std::abs(cycleCount) % 2 != 0) { // odd, bouncing back
-                 return Evaluate(lastTime - wrappedT);
-             } else {
-                 return Evaluate(firstTime + wrappedT);
-             }
+        case Bounce: {
+            float cycleCount = floor((t - firstTime) / duration);
+            float wrappedT = t - firstTime - cycleCount * duration;
+            // If cycleCount is even, forward. If odd, backward.
+            if ((int)cycleCount % 2 != 0) {
+                return Evaluate(lastTime - wrappedT);
+            }
+            return Evaluate(firstTime + wrappedT);
         }
-        else return keyframes.front().value; // Default constant
-    }
-    else if (t > lastTime) {
-         if (extrapolateOut == "constant") return keyframes.back().value;
-         else if (extrapolateOut == "linear") {
-             float slope = keyframes.back().tangentOutValue; // Out tangent of last key
-             return keyframes.back().value + slope * (t - lastTime);
-         }
-         else if (extrapolateOut == "cycle") {
-             float wrappedT = fmod(t - firstTime, duration);
-             if (wrappedT < 0) wrappedT += duration;
-             return Evaluate(firstTime + wrappedT);
-         }
-         else if (extrapolateOut == "cycle_offset") {
-             float cycleCount = floor((t - firstTime) / duration);
-             float wrappedT = t - firstTime - cycleCount * duration;
-             float offset = (keyframes.back().value - keyframes.front().value) * cycleCount;
-             return Evaluate(firstTime + wrappedT) + offset;
-         }
-         else if (extrapolateOut == "bounce") {
-             float cycleCount = floor((t - firstTime) / duration); 
-             float wrappedT = t - firstTime - cycleCount * duration;
-             // If cycleCount is even, forward. If odd, backward.
-             if ((int)cycleCount % 2 != 0) { // odd, backwards
-                 // e.g. 1..2. cycle=1. wrappedT = t-first-dur. 
-                 // we want evaluate(last - wrappedT).
-                 return Evaluate(lastTime - wrappedT);
-             } else {
-                 return Evaluate(firstTime + wrappedT);
-             }
-         }
-         else return keyframes.back().value; // Default constant
+        case Constant:
+        default:
+            return before ? first.value : last.value;
     }
+}
 
-    // Find segment
-    // base case fall into this loop
-    for (size_t i = 0; i < keyframes.size() - 1; ++i) {
-        if (t >= keyframes[i].time && t <= keyframes[i+1].time) {
-            return EvaluateSegment(i, t);
-        }
+glm::ivec4 Channel::Compile(std::vector<glm::vec4>& keyTable) const {
+    int first = (int)keyTable.size() / 2;
+    for (const Keyframe& key : keyframes) {
+        keyTable.push_back(glm::vec4(key.time, key.value, key.tangentInValue, key.tangentOutValue));
+        keyTable.push_back(glm::vec4(key.A, key.B, key.C, key.D));
     }
-    return keyframes.back().value;
+    return glm::ivec4(first, (int)keyframes.size(), (int)extrapIn, (int)extrapOut);
 }
 
-float Channel::EvaluateSegment(int i, float t) {
-    Keyframe& p0 = keyframes[i];
-    Keyframe& p1 = keyframes[i+1];
+float Channel::EvaluateSegment(int i, float t) const {
+    const Keyframe& p0 = keyframes[i];
+    const Keyframe& p1 = keyframes[i+1];
     
     // Normalize t to 0..1 range
     float u = (t - p0.time) / (p1.time - p0.time);
     
-    // Cubic Hermite Spline
-    
-    float dt = p1.time - p0.time;
-    float m0 = p0.tangentOutValue * dt;
-    float m1 = p1.tangentInValue * dt;
-    
-    float u2 = u * u;
-    float u3 = u2 * u;
-    
-    return (2*u3 - 3*u2 + 1) * p0.value +
-           (u3 - 2*u2 + u) * m0 +
-           (-2*u3 + 3*u2) * p1.value +
-           (u3 - u2) * m1;
+    // Cubic Hermite Spline, using the coefficients from Precompute
+    return ((p0.A * u + p0.B) * u + p0.C) * u + p0.D;
 }
 
 void Channel::Precompute() {
+    extrapIn = ParseExtrapolation(extrapolateIn);
+    extrapOut = ParseExtrapolation(extrapolateOut);
+
     if (keyframes.empty()) return;
 
     // Calculate tangents for each keyframe based on rules
@@ -307,4 +443,24 @@ void Channel::Precompute() {
         }
         // Fixed is already set
     }
-}
+
+    // Cubic coefficients per segment (stored on the segment's first key)
+    // x(u) = A u^3 + B u^2 + C u + D, with tangents scaled to the 0..1 span
+    for (size_t i = 0; i < keyframes.size(); ++i) {
+        Keyframe& p0 = keyframes[i];
+        if (i + 1 == keyframes.size()) {
+            p0.A = p0.B = p0.C = 0.0f;
+            p0.D = p0.value;
+            break;
+        }
+        const Keyframe& p1 = keyframes[i+1];
+        float dt = p1.time - p0.time;
+        float m0 = p0.tangentOutValue * dt;
+        float m1 = p1.tangentInValue * dt;
+
+        p0.A = 2 * p0.value - 2 * p1.value + m0 + m1;
+        p0.B = -3 * p0.value + 3 * p1.value - 2 * m0 - m1;
+        p0.C = m0;
+        p0.D = p0.value;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "CpuSkinner.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_SKINNER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CPU_SKINNER_AVX2_TARGET
+#else
+// Compile just the AVX2 kernel for AVX2/FMA; the rest stays baseline x86
+#define CPU_SKINNER_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+CpuSkinner::CpuSkinner() {
+    numVerts = 0;
+    chunkSize = 4096;
+}
+
+bool CpuSkinner::HasAvx2() {
+#if !defined(CPU_SKINNER_X86)
+    return false;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    static const bool supported = [] {
+        int info[4];
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!fma || !osxsave || (_xgetbv(0) & 6) != 6) return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+    return supported;
+#else
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+#endif
+}
+
+void CpuSkinner::Prepare(const Skin& skin) {
+    const std::vector<glm::vec3>& positions = skin.GetPositions();
+    const std::vector<glm::vec3>& normals = skin.GetNormals();
+    const std::vector<int>& skinOffsets = skin.GetInfluenceOffsets();
+    const std::vector<int>& skinJoints = skin.GetInfluenceJoints();
+    const std::vector<float>& skinWeights = skin.GetInfluenceWeights();
+    int numBones = skin.GetNumBones();
+
+    numVerts = skin.GetNumVertices();
+    px.resize(numVerts); py.resize(numVerts); pz.resize(numVerts);
+    nx.resize(numVerts); ny.resize(numVerts); nz.resize(numVerts);
+    offsets.assign(numVerts + 1, 0);
+    bones.clear();
+    weights.clear();
+
+    for (int v = 0; v < numVerts; v++) {
+        px[v] = positions[v].x; py[v] = positions[v].y; pz[v] = positions[v].z;
+        glm::vec3 n = v < (int)normals.size() ? normals[v] : glm::vec3(0, 1, 0);
+        nx[v] = n.x; ny[v] = n.y; nz[v] = n.z;
+
+        if (v + 1 < (int)skinOffsets.size()) {
+            for (int k = skinOffsets[v]; k < skinOffsets[v + 1]; k++) {
+                // Out-of-range joints contribute nothing (and must not be gathered)
+                if (skinJoints[k] < 0 || skinJoints[k] >= numBones) continue;
+                bones.push_back(skinJoints[k]);
+                weights.push_back(skinWeights[k]);
+            }
+        }
+        offsets[v + 1] = (int)bones.size();
+    }
+}
+
+void CpuSkinner::Deform(const glm::mat4* palette, SkinnedVertices& out) const {
+    if (out.GetNumVertices() != numVerts) out.Resize(numVerts);
+    if (numVerts == 0) return;
+
+    const float* pal = &palette[0][0][0];
+    int numChunks = (numVerts + chunkSize - 1) / chunkSize;
+    ThreadPool::Get().ParallelFor(numChunks, [&](int c) {
+        int begin = c * chunkSize;
+        int end = std::min(begin + chunkSize, numVerts);
+        DeformRange(pal, out, begin, end);
+    });
+}
+
+void CpuSkinner::DeformRange(const float* palette, SkinnedVertices& out, int begin, int end) const {
+#ifdef CPU_SKINNER_X86
+    if (HasAvx2()) {
+        DeformAvx2(palette, out, begin, end);
+        return;
+    }
+#endif
+    DeformScalar(palette, out, begin, end);
+}
+
+void CpuSkinner::DeformScalar(const float* palette, SkinnedVertices& out, int begin, int end) const {
+    for (int v = begin; v < end; v++) {
+        // Blended upper 3x4 of the skinning matrix, column-major: m[c*3 + r]
+        float m[12] = {0};
+        for (int k = offsets[v]; k < offsets[v + 1]; k++) {
+            float w = weights[k];
+            const float* M = palette + 16 * bones[k];
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 3; r++) {
+                    m[c * 3 + r] += w * M[c * 4 + r];
+                }
+            }
+        }
+
+        out.px[v] = m[0] * px[v] + m[3] * py[v] + m[6] * pz[v] + m[9];
+        out.py[v] = m[1] * px[v] + m[4] * py[v] + m[7] * pz[v] + m[10];
+        out.pz[v] = m[2] * px[v] + m[5] * py[v] + m[8] * pz[v] + m[11];
+
+        float tx = m[0] * nx[v] + m[3] * ny[v] + m[6] * nz[v];
+        float ty = m[1] * nx[v] + m[4] * ny[v] + m[7] * nz[v];
+        float tz = m[2] * nx[v] + m[5] * ny[v] + m[8] * nz[v];
+        float len = std::sqrt(tx * tx + ty * ty + tz * tz);
+        float inv = len > 0.0f ? 1.0f / len : 0.0f;
+        out.nx[v] = tx * inv;
+        out.ny[v] = ty * inv;
+        out.nz[v] = tz * inv;
+    }
+}
+
+#ifdef CPU_SKINNER_X86
+
+CPU_SKINNER_AVX2_TARGET
+void CpuSkinner::DeformAvx2(const float* palette, SkinnedVertices& out, int begin, int end) const {
+    int v = begin;
+    for (; v + 8 <= end; v += 8) {
+        // Blend the upper 3x4 of each vertex's bone matrices for 8 vertices
+        // at once. Each lane gathers its own bone's element, so the palette
+        // stays AoS. The group runs as many rounds as its widest vertex;
+        // lanes that are already done are masked to weight 0, bone 0.
+        __m256 m[12];
+        for (int e = 0; e < 12; e++) m[e] = _mm256_setzero_ps();
+
+        __m256i first = _mm256_loadu_si256((const __m256i*)&offsets[v]);
+        __m256i count = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)&offsets[v + 1]), first);
+        int rounds = 0;
+        for (int i = 0; i < 8; i++) rounds = std::max(rounds, offsets[v + i + 1] - offsets[v + i]);
+
+        for (int k = 0; k < rounds; k++) {
+            __m256i kk = _mm256_set1_epi32(k);
+            __m256i active = _mm256_cmpgt_epi32(count, kk);
+            __m256i idx = _mm256_add_epi32(first, kk);
+            __m256i bone = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), bones.data(), idx, active, 4);
+            __m256 w = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), weights.data(), idx, _mm256_castsi256_ps(active), 4);
+            __m256i base = _mm256_slli_epi32(bone, 4); // * 16 floats
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 3; r++) {
+                    __m256 g = _mm256_i32gather_ps(palette + c * 4 + r, base, 4);
+                    m[c * 3 + r] = _mm256_fmadd_ps(w, g, m[c * 3 + r]);
+                }
+            }
+        }
+
+        __m256 x = _mm256_loadu_ps(&px[v]);
+        __m256 y = _mm256_loadu_ps(&py[v]);
+        __m256 z = _mm256_loadu_ps(&pz[v]);
+        for (int r = 0; r < 3; r++) {
+            __m256 p = _mm256_fmadd_ps(m[r], x, _mm256_fmadd_ps(m[3 + r], y, _mm256_fmadd_ps(m[6 + r], z, m[9 + r])));
+            float* dst = r == 0 ? &out.px[v] : r == 1 ? &out.py[v] : &out.pz[v];
+            _mm256_storeu_ps(dst, p);
+        }
+
+        x = _mm256_loadu_ps(&nx[v]);
+        y = _mm256_loadu_ps(&ny[v]);
+        z = _mm256_loadu_ps(&nz[v]);
+        __m256 n[3];
+        for (int r = 0; r < 3; r++) {
+            n[r] = _mm256_fmadd_ps(m[r], x, _mm256_fmadd_ps(m[3 + r], y, _mm256_mul_ps(m[6 + r], z)));
+        }
+        __m256 len2 = _mm256_fmadd_ps(n[0], n[0], _mm256_fmadd_ps(n[1], n[1], _mm256_mul_ps(n[2], n[2])));
+        __m256 len = _mm256_sqrt_ps(len2);
+        __m256 nonZero = _mm256_cmp_ps(len, _mm256_setzero_ps(), _CMP_GT_OQ);
+        __m256 inv = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), len), nonZero);
+        _mm256_storeu_ps(&out.nx[v], _mm256_mul_ps(n[0], inv));
+        _mm256_storeu_ps(&out.ny[v], _mm256_mul_ps(n[1], inv));
+        _mm256_storeu_ps(&out.nz[v], _mm256_mul_ps(n[2], inv));
+    }
+
+    // Tail
+    DeformScalar(palette, out, v, end);
+}
+
+#else
+
+void CpuSkinner::DeformAvx2(const float* palette, SkinnedVertices& out, int begin, int end) const {
+    DeformScalar(palette, out, begin, end);
+}
+
+#endif
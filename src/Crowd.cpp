@@ -0,0 +1,415 @@
+#include "Crowd.h"
+#include "SkinPalette.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+
+namespace {
+
+// Characters per ThreadPool task
+const int InstanceChunk = 64;
+
+// lastAnimated of a skeleton that must be caught up before it's drawn
+const int Never = INT_MIN / 2;
+
+// A template rather than std::function, which would allocate for lambdas
+// capturing this much
+template <typename Fn>
+void ForEachChunk(int count, const Fn& fn) {
+    int numChunks = (count + InstanceChunk - 1) / InstanceChunk;
+    ThreadPool::Get().ParallelFor(numChunks, [&](int c) {
+        fn(c * InstanceChunk, std::min((c + 1) * InstanceChunk, count));
+    });
+}
+
+}
+
+Crowd::Crowd(Skin* skin, const SkeletonDefinition* def) : jointQuery(def) {
+    this->skin = skin;
+    definition = def;
+    numBatches = 0;
+    numBaked = 0;
+    numCulled = 0;
+    instanceBuffer = 0;
+    offsetBuffer = 0;
+    animation = nullptr;
+    binding = nullptr;
+    time = 0.0f;
+    vat = nullptr;
+    vatShader = 0;
+    vatLod = 0;
+    gpuAnimator = nullptr;
+    clipBoundsAnimation = nullptr;
+    clipBoundsValid = false;
+    clipCenter = clipExtent = glm::vec3(0.0f);
+    fullRateDistance = 0.0f;
+    updateBudget = 0;
+    frame = 0;
+    numAnimated = 0;
+    numDeferred = 0;
+}
+
+Crowd::~Crowd() {
+    glDeleteBuffers(1, &instanceBuffer);
+    glDeleteBuffers(1, &offsetBuffer);
+}
+
+void Crowd::SetVertexAnimation(const VertexAnimationTexture* vat, GLuint shader, int fromLod) {
+    this->vat = vat;
+    vatShader = shader;
+    vatLod = fromLod;
+}
+
+void Crowd::SetGpuAnimator(GpuAnimator* animator) {
+    gpuAnimator = animator;
+    if (animator) {
+        skin->SetPaletteFormat(Skin::PaletteAffine3x4);
+        skin->SetRigidBones(true);
+    }
+    // Skeletons are stale when going back to the CPU
+    lastAnimated.assign(instances.size(), Never);
+    lodOf.clear();
+}
+
+void Crowd::SpawnGrid(int count, float spacing) {
+    instances.clear();
+    models.clear();
+    phases.clear();
+    lodOf.clear();
+    count = std::max(count, 0);
+    instances.reserve(count);
+
+    int side = (int)std::ceil(std::sqrt((float)count));
+    float half = 0.5f * (side - 1) * spacing;
+    for (int i = 0; i < count; i++) {
+        instances.emplace_back(definition);
+        // The crowd already runs one character per task
+        instances.back().SetParallelThreshold(INT_MAX);
+
+        glm::vec3 position((i % side) * spacing - half, 0.0f, (i / side) * spacing - half);
+        models.push_back(glm::translate(position));
+        // Golden ratio steps spread the offsets evenly over the clip
+        float phase = i * 0.618034f;
+        phases.push_back(phase - std::floor(phase));
+    }
+    lastAnimated.assign(count, Never);
+    poseCenters.assign(count, glm::vec3(0.0f));
+    poseExtents.assign(count, glm::vec3(0.0f));
+    updateInterval.assign(count, 1);
+    innerOnly.assign(count, 0);
+}
+
+void Crowd::SetUpdateRates(float fullRateDistance) {
+    this->fullRateDistance = std::max(fullRateDistance, 0.0f);
+}
+
+int Crowd::SelectUpdateInterval(float distance) const {
+    int interval = 1;
+    if (fullRateDistance <= 0.0f) return interval;
+    for (float limit = fullRateDistance; distance >= limit && interval < 8; limit *= 2.0f) interval *= 2;
+    return interval;
+}
+
+void Crowd::Update(const Animation* animation, const AnimationBinding& binding, float time) {
+    this->animation = animation;
+    this->binding = &binding;
+    this->time = time;
+
+    numAnimated = numDeferred = 0;
+    // Nothing to do here when the GPU samples the clip
+    if (gpuAnimator) return;
+
+    // Last frame's LOD decides who is baked or culled (Draw catches those
+    // up); the rest are due on their turn, or when over budget made them miss
+    // it. Turns are offset by index so every rate's load is spread evenly.
+    frame++;
+    int count = (int)instances.size();
+    bool knownLods = lodOf.size() == instances.size();
+    due.clear();
+    for (int i = 0; i < count; i++) {
+        if (knownLods && (lodOf[i] == Culled || IsBaked(lodOf[i]))) {
+            lastAnimated[i] = Never;
+            continue;
+        }
+        int interval = updateInterval[i];
+        if (((frame + i) & (interval - 1)) == 0 || frame - lastAnimated[i] > interval) due.push_back(i);
+    }
+
+    if (updateBudget > 0 && (int)due.size() > updateBudget) {
+        // Most overdue for their rate first, then the faster rates
+        std::nth_element(due.begin(), due.begin() + updateBudget, due.end(), [&](int a, int b) {
+            float lateA = (float)(frame - lastAnimated[a]) / updateInterval[a];
+            float lateB = (float)(frame - lastAnimated[b]) / updateInterval[b];
+            return lateA != lateB ? lateA > lateB : updateInterval[a] < updateInterval[b];
+        });
+        numDeferred = (int)due.size() - updateBudget;
+        due.resize(updateBudget);
+    }
+
+    numAnimated = (int)due.size();
+    ForEachChunk(numAnimated, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) Animate(due[k]);
+    });
+}
+
+void Crowd::Animate(int i) {
+    SkeletonInstance& instance = instances[i];
+    const std::vector<int>& inner = definition->GetInnerJoints();
+    if (animation) {
+        float clipTime = GetClipTime(i);
+        if (innerOnly[i]) {
+            animation->SampleJoints(clipTime, *binding, inner.data(), (int)inner.size(), instance.GetPose());
+        } else {
+            animation->Sample(clipTime, *binding, instance.GetPose());
+        }
+    }
+    if (innerOnly[i]) {
+        instance.UpdateInnerJoints();
+    } else {
+        instance.Update();
+    }
+    lastAnimated[i] = frame;
+    // Kept for culling on the Updates this pose is drawn again
+    const std::vector<glm::mat4>& world = instance.GetWorldMatrices();
+    skin->ComputeBounds(world.data(), (int)world.size(), poseCenters[i], poseExtents[i]);
+}
+
+void Crowd::EvaluateJoints(int character, const int* joints, int count, glm::mat4* world) {
+    const glm::mat4& model = models[character];
+    // A pose Animate left is exactly what is drawn, even between turns
+    if (!gpuAnimator && lastAnimated[character] != Never) {
+        const SkeletonInstance& instance = instances[character];
+        for (int q = 0; q < count; q++) world[q] = model * instance.GetWorldMatrix(joints[q]);
+        return;
+    }
+
+    // The rest have no current skeleton: just the queried chains
+    if (animation && binding) {
+        animation->SampleChains(GetClipTime(character), *binding, *definition, joints, count, jointQuery.GetPose());
+    } else {
+        jointQuery.ResetPose();
+    }
+    for (int q = 0; q < count; q++) world[q] = model * jointQuery.EvaluateJoint(joints[q]);
+}
+
+float Crowd::GetClipTime(int i) const {
+    // Wrapped rather than extrapolated: the vertex animation texture only
+    // holds one cycle, so a cycle_offset root channel would otherwise walk
+    // skinned characters away from where their baked copies are drawn
+    float start = animation->GetStartTime();
+    float length = animation->GetEndTime() - start;
+    if (length <= 0.0f) return start;
+    float t = std::fmod(time - start + phases[i] * length, length);
+    return start + (t < 0.0f ? t + length : t);
+}
+
+glm::vec3 Crowd::GetRootTranslation(int i) const {
+    // As SkeletonInstance::ResetPose leaves it, for channels the clip lacks
+    glm::vec3 translation = definition->GetNumJoints() > 0 ? definition->GetOffset(0) : glm::vec3(0.0f);
+    if (animation && binding) animation->SampleRootTranslation(GetClipTime(i), *binding, translation);
+    return translation;
+}
+
+void Crowd::UpdateClipBounds() {
+    if (clipBoundsValid && clipBoundsAnimation == animation) return;
+    clipBoundsAnimation = animation;
+    clipBoundsValid = true;
+
+    // Every pose at 30 fps, padded a little for motion between samples
+    const float sampleRate = 30.0f;
+    SkeletonInstance instance(definition);
+    float start = animation ? animation->GetStartTime() : 0.0f;
+    float length = animation ? animation->GetEndTime() - start : 0.0f;
+    int numSamples = std::max(1, (int)std::ceil(length * sampleRate) + 1);
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (int s = 0; s < numSamples; s++) {
+        if (animation && binding) animation->Sample(start + std::min(s / sampleRate, length), *binding, instance.GetPose());
+        // Both the full pose and the inner-only one (leaves at rest) that
+        // far characters are drawn with
+        for (int inner = 0; inner < 2; inner++) {
+            if (inner) instance.UpdateInnerJoints();
+            else instance.Update();
+            const std::vector<glm::mat4>& world = instance.GetWorldMatrices();
+            glm::vec3 center, extent;
+            skin->ComputeBounds(world.data(), (int)world.size(), center, extent);
+            center -= instance.GetPose().RootTranslation();
+            lo = glm::min(lo, center - extent);
+            hi = glm::max(hi, center + extent);
+        }
+    }
+    clipCenter = 0.5f * (lo + hi);
+    clipExtent = 0.5f * (hi - lo) * 1.05f;
+}
+
+void Crowd::Draw(const glm::mat4& viewProjMtx, const GLuint shaders[Skin::NumInfluenceClasses]) {
+    numBatches = 0;
+    numBaked = 0;
+    numCulled = 0;
+    int count = (int)instances.size();
+    if (count == 0) return;
+
+    const std::vector<glm::mat4>& inverseBindings = skin->GetInverseBindings();
+    int numBones = (int)inverseBindings.size();
+    int numLods = skin->GetNumLods();
+
+    // Frustum culling: a box per character, then four boxes per test
+    UpdateClipBounds();
+    Frustum frustum(viewProjMtx);
+    bounds.Resize(count);
+    visible.resize(count);
+    ForEachChunk(count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            glm::vec3 center, extent;
+            if (!gpuAnimator && lastAnimated[i] != Never) {
+                TransformBox(models[i], poseCenters[i], poseExtents[i], center, extent);
+            } else {
+                TransformBox(models[i], clipCenter + GetRootTranslation(i), clipExtent, center, extent);
+            }
+            bounds.Set(i, center, extent);
+        }
+        frustum.Cull(bounds, begin, end, visible.data());
+    });
+
+    // Level of detail per visible character from its root bone, then a
+    // counting sort so each level's instances are contiguous. The view depth
+    // of its root (clip w) sets its animation rate for the next Update.
+    glm::vec4 row3(viewProjMtx[0][3], viewProjMtx[1][3], viewProjMtx[2][3], viewProjMtx[3][3]);
+    lodOf.resize(count);
+    ForEachChunk(count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            if (!visible[i]) {
+                lodOf[i] = Culled;
+                continue;
+            }
+            glm::mat4 root = models[i];
+            if (gpuAnimator) {
+                lodOf[i] = skin->SelectLod(viewProjMtx, root);
+                continue;
+            }
+            if (numBones > 0) root = root * instances[i].GetWorldMatrix(0) * inverseBindings[0];
+            lodOf[i] = skin->SelectLod(viewProjMtx, root);
+            // Where root motion has taken it; a stale skeleton's root is
+            // wherever its clip time puts it now
+            glm::vec4 rootPosition = lastAnimated[i] != Never && numBones > 0
+                ? instances[i].GetWorldMatrix(0)[3] : glm::vec4(GetRootTranslation(i), 1.0f);
+            float distance = glm::dot(row3, models[i] * rootPosition);
+            updateInterval[i] = (unsigned char)SelectUpdateInterval(distance);
+            innerOnly[i] = fullRateDistance > 0.0f && distance >= 8.0f * fullRateDistance;
+            // Came back from the baked range or into view: catch the skeleton
+            // up, whatever the budget, rather than show a stale pose
+            if (!IsBaked(lodOf[i]) && lastAnimated[i] == Never && binding) Animate(i);
+        }
+    });
+    lodStart.assign(numLods + 1, 0);
+    for (int i = 0; i < count; i++) {
+        if (lodOf[i] != Culled) lodStart[lodOf[i] + 1]++;
+    }
+    for (int l = 0; l < numLods; l++) lodStart[l + 1] += lodStart[l];
+    int drawn = lodStart[numLods];
+    numCulled = count - drawn;
+    if (drawn == 0) return;
+
+    cursor.assign(lodStart.begin(), lodStart.end() - 1);
+    order.resize(drawn);
+    drawModels.resize(drawn);
+    for (int i = 0; i < count; i++) {
+        if (lodOf[i] == Culled) continue;
+        int slot = cursor[lodOf[i]]++;
+        order[slot] = i;
+        drawModels[slot] = models[i];
+    }
+
+    if (!instanceBuffer) glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, drawn * sizeof(glm::mat4), drawModels.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Baked characters: one instanced draw per level, no palettes at all
+    int skinnedLods = numLods;
+    if (vat && vatLod < numLods) {
+        skinnedLods = vatLod;
+        int firstBaked = lodStart[vatLod];
+        numBaked = drawn - firstBaked;
+        if (numBaked > 0) {
+            // Each character's wrapped clip time goes in its offset, so the
+            // shader's time is 0 and the frame matches the skinned paths
+            drawOffsets.resize(drawn);
+            for (int k = firstBaked; k < drawn; k++) {
+                drawOffsets[k] = animation ? GetClipTime(order[k]) - animation->GetStartTime() : 0.0f;
+            }
+
+            if (!offsetBuffer) glGenBuffers(1, &offsetBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, offsetBuffer);
+            glBufferData(GL_ARRAY_BUFFER, drawn * sizeof(float), drawOffsets.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            for (int level = vatLod; level < numLods; level++) {
+                int batch = lodStart[level + 1] - lodStart[level];
+                if (batch == 0) continue;
+                vat->DrawInstanced(viewProjMtx, vatShader, level, 0.0f, instanceBuffer, offsetBuffer, lodStart[level], batch);
+                numBatches++;
+            }
+        }
+    }
+
+    if (gpuAnimator) {
+        DrawGpuAnimated(viewProjMtx, shaders, skinnedLods);
+        return;
+    }
+
+    // Palettes go straight into the mapped bone buffer. A batch is as many
+    // characters as one allocation can hold.
+    paletteBuffer.BeginFrame();
+    int stride = skin->GetPaletteTexels();
+    int maxBatch = std::max(1, paletteBuffer.GetMaxCapacity() * 4 / std::max(stride, 1));
+    // One palette per chunk of a batch, kept across frames; bones past the
+    // skeleton's joints stay identity
+    size_t scratchSize = (size_t)((maxBatch + InstanceChunk - 1) / InstanceChunk) * numBones;
+    if (paletteScratch.size() != scratchSize) paletteScratch.assign(scratchSize, glm::mat4(1.0f));
+
+    for (int level = 0; level < skinnedLods; level++) {
+        for (int first = lodStart[level]; first < lodStart[level + 1]; first += maxBatch) {
+            int batch = std::min(maxBatch, lodStart[level + 1] - first);
+            int boneBase = -1;
+            glm::vec4* texels = (glm::vec4*)paletteBuffer.Allocate((batch * stride + 3) / 4, boneBase);
+            if (!texels) break;
+
+            ForEachChunk(batch, [&](int begin, int end) {
+                glm::mat4* palette = paletteScratch.data() + (size_t)(begin / InstanceChunk) * numBones;
+                for (int k = begin; k < end; k++) {
+                    const std::vector<glm::mat4>& world = instances[order[first + k]].GetWorldMatrices();
+                    BuildSkinPalette(world.data(), inverseBindings.data(), std::min((int)world.size(), numBones), palette);
+                    skin->PackPalette(palette, texels + k * stride);
+                }
+            });
+            paletteBuffer.Commit();
+
+            paletteBuffer.Bind(0);
+            skin->DrawInstanced(viewProjMtx, shaders, level, boneBase, instanceBuffer, first, batch);
+            numBatches++;
+        }
+    }
+    paletteBuffer.EndFrame();
+}
+
+void Crowd::DrawGpuAnimated(const glm::mat4& viewProjMtx, const GLuint shaders[Skin::NumInfluenceClasses],
+    int skinnedLods) {
+    if (gpuAnimator->GetPaletteTexels() != skin->GetPaletteTexels()) return;
+
+    // Only the clip times go up; the palettes never leave the GPU
+    drawTimes.resize(order.size());
+    for (int k = 0; k < lodStart[skinnedLods]; k++) drawTimes[k] = animation ? GetClipTime(order[k]) : time;
+
+    int maxBatch = gpuAnimator->GetMaxInstances();
+    for (int level = 0; level < skinnedLods; level++) {
+        for (int first = lodStart[level]; first < lodStart[level + 1]; first += maxBatch) {
+            int batch = std::min(maxBatch, lodStart[level + 1] - first);
+            gpuAnimator->Evaluate(drawTimes.data() + first, batch);
+            gpuAnimator->Bind(0);
+            skin->DrawInstanced(viewProjMtx, shaders, level, 0, instanceBuffer, first, batch);
+            numBatches++;
+        }
+    }
+}
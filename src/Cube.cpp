@@ -1,4 +1,5 @@
 #include "Cube.h"
+#include "ShaderProgram.h"
 
 Cube::Cube(glm::vec3 cubeMin, glm::vec3 cubeMax) {
     // Model matrix.
@@ -99,7 +100,7 @@ Cube::Cube(glm::vec3 cubeMin, glm::vec3 cubeMax) {
     glGenBuffers(1, &VBO_normals);
 
     // Bind to the VAO.
-    glBindVertexArray(VAO);
+    BoundState::BindVertexArray(VAO);
 
     // Bind to the first VBO - We will use it to store the vertices
     glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
@@ -120,7 +121,7 @@ Cube::Cube(glm::vec3 cubeMin, glm::vec3 cubeMax) {
 
     // Unbind the VBOs.
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    BoundState::BindVertexArray(0);
 }
 
 Cube::~Cube() {
@@ -128,27 +129,47 @@ Cube::~Cube() {
     glDeleteBuffers(1, &VBO_positions);
     glDeleteBuffers(1, &VBO_normals);
     glDeleteBuffers(1, &EBO);
-    glDeleteVertexArrays(1, &VAO);
+    BoundState::DeleteVertexArray(VAO);
 }
 
 void Cube::draw(const glm::mat4& viewProjMtx, GLuint shader) {
     // actiavte the shader program
-    glUseProgram(shader);
+    const ShaderProgram& program = ShaderProgram::Get(shader);
+    program.Use();
 
-    // get the locations and send the uniforms to the shader
-    glUniformMatrix4fv(glGetUniformLocation(shader, "viewProj"), 1, false, (float*)&viewProjMtx);
-    glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, (float*)&model);
-    glUniform3fv(glGetUniformLocation(shader, "DiffuseColor"), 1, &color[0]);
+    // send the uniforms to the shader (locations were looked up at link time)
+    glUniformMatrix4fv(program.GetLocation(ShaderProgram::ViewProj), 1, false, (float*)&viewProjMtx);
+    glUniformMatrix4fv(program.GetLocation(ShaderProgram::Model), 1, GL_FALSE, (float*)&model);
+    glUniform3fv(program.GetLocation(ShaderProgram::DiffuseColor), 1, &color[0]);
 
     // Bind the VAO
-    glBindVertexArray(VAO);
+    BoundState::BindVertexArray(VAO);
 
     // draw the points using triangles, indexed with the EBO
     glDrawElements(GL_LINES, indices.size(), GL_UNSIGNED_INT, 0);
 
     // Unbind the VAO and shader program
-    glBindVertexArray(0);
-    glUseProgram(0);
+    BoundState::BindVertexArray(0);
+    BoundState::UseProgram(0);
+}
+
+void Cube::submit(RenderQueue& queue, GLuint shader) const {
+    RenderQueue::Packet packet;
+    packet.program = shader;
+    packet.vertexArray = VAO;
+    packet.draw = &Cube::drawPacket;
+    packet.object = this;
+    packet.model = model;
+    queue.Submit(RenderQueue::MakeKey(RenderQueue::Opaque, shader, VAO), packet);
+}
+
+void Cube::drawPacket(const RenderQueue::Packet& packet) {
+    // program, VAO and viewProj are already set by the queue
+    const Cube* cube = (const Cube*)packet.object;
+    const ShaderProgram& program = ShaderProgram::Get(packet.program);
+    glUniformMatrix4fv(program.GetLocation(ShaderProgram::Model), 1, GL_FALSE, (float*)&packet.model);
+    glUniform3fv(program.GetLocation(ShaderProgram::DiffuseColor), 1, &cube->color[0]);
+    glDrawElements(GL_LINES, cube->indices.size(), GL_UNSIGNED_INT, 0);
 }
 
 void Cube::update() {
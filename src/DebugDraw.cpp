@@ -0,0 +1,158 @@
+#include "DebugDraw.h"
+#include "ShaderProgram.h"
+#include <cstddef>
+
+namespace {
+
+// Vertex of the shared mesh: position is a unit box corner (0..1 per axis)
+// for part 0, the endpoint (x = 0 joint, 1 parent) for the bone, and the
+// endpoint along the axis for parts 2-4
+struct DebugVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    float part; // 0 box, 1 bone, 2/3/4 x/y/z axis
+};
+
+}
+
+DebugDraw::DebugDraw() {
+    parts = Boxes;
+
+    // Box faces in Cube's order and with its normals, so the lighting matches
+    const glm::vec3 faceNormals[6] = { glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0),
+                                       glm::vec3(0, -1, 0), glm::vec3(-1, 0, 0), glm::vec3(1, 0, 0) };
+    const glm::vec3 faceCorners[6][4] = {
+        { glm::vec3(0, 0, 1), glm::vec3(1, 0, 1), glm::vec3(1, 1, 1), glm::vec3(0, 1, 1) },
+        { glm::vec3(1, 0, 0), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0), glm::vec3(1, 1, 0) },
+        { glm::vec3(0, 1, 1), glm::vec3(1, 1, 1), glm::vec3(1, 1, 0), glm::vec3(0, 1, 0) },
+        { glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(1, 0, 1), glm::vec3(0, 0, 1) },
+        { glm::vec3(0, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 1), glm::vec3(0, 1, 0) },
+        { glm::vec3(1, 0, 1), glm::vec3(1, 0, 0), glm::vec3(1, 1, 0), glm::vec3(1, 1, 1) } };
+
+    std::vector<DebugVertex> vertices;
+    std::vector<unsigned short> indices;
+    for (int f = 0; f < 6; f++) {
+        unsigned short base = (unsigned short)vertices.size();
+        for (int k = 0; k < 4; k++) {
+            vertices.push_back({ faceCorners[f][k], faceNormals[f], 0.0f });
+            indices.push_back(base + k);
+            indices.push_back(base + (k + 1) % 4);
+        }
+    }
+
+    // Bone, then the three axes, as plain segments
+    const glm::vec3 ends[4] = { glm::vec3(1, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) };
+    for (int p = 0; p < 4; p++) {
+        indices.push_back((unsigned short)vertices.size());
+        vertices.push_back({ glm::vec3(0.0f), glm::vec3(0.0f), (float)(p + 1) });
+        indices.push_back((unsigned short)vertices.size());
+        vertices.push_back({ ends[p], glm::vec3(0.0f), (float)(p + 1) });
+    }
+    numIndices = (int)indices.size();
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    glGenBuffers(1, &instanceBuffer);
+    BoundState::BindVertexArray(VAO);
+
+    // Position (Loc 0), normal (Loc 1), part (Loc 2)
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(DebugVertex), vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)offsetof(DebugVertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)offsetof(DebugVertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)offsetof(DebugVertex, part));
+
+    // Per joint: world matrix (Loc 3-6), box min/max (Loc 7, 8), parent origin (Loc 9)
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    for (int c = 0; c < 4; c++) {
+        glEnableVertexAttribArray(3 + c);
+        glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, sizeof(JointInstance),
+            (void*)(offsetof(JointInstance, world) + c * sizeof(glm::vec4)));
+        glVertexAttribDivisor(3 + c, 1);
+    }
+    const size_t extras[3] = { offsetof(JointInstance, boxMin), offsetof(JointInstance, boxMax),
+                               offsetof(JointInstance, parentOrigin) };
+    for (int i = 0; i < 3; i++) {
+        glEnableVertexAttribArray(7 + i);
+        glVertexAttribPointer(7 + i, 3, GL_FLOAT, GL_FALSE, sizeof(JointInstance), (void*)extras[i]);
+        glVertexAttribDivisor(7 + i, 1);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+
+    BoundState::BindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+DebugDraw::~DebugDraw() {
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &instanceBuffer);
+    BoundState::DeleteVertexArray(VAO);
+}
+
+void DebugDraw::AddSkeleton(const SkeletonInstance& skeleton, const glm::mat4& model) {
+    const SkeletonDefinition* def = skeleton.GetDefinition();
+    const std::vector<glm::mat4>& world = skeleton.GetWorldMatrices();
+    int numJoints = def->GetNumJoints();
+    size_t first = instances.size();
+    instances.resize(first + numJoints);
+    for (int j = 0; j < numJoints; j++) {
+        JointInstance& instance = instances[first + j];
+        instance.world = model * world[j];
+        instance.boxMin = glm::vec4(def->GetBoxMin(j), 0.0f);
+        instance.boxMax = glm::vec4(def->GetBoxMax(j), 0.0f);
+        // Parents come first in DFS order, so theirs is already filled in
+        int parent = def->GetParent(j);
+        instance.parentOrigin = parent < 0 ? instance.world[3] : instances[first + parent].world[3];
+    }
+}
+
+void DebugDraw::Draw(const glm::mat4& viewProjMtx, GLuint shader) {
+    if (instances.empty()) return;
+    UploadInstances();
+
+    const ShaderProgram& program = ShaderProgram::Get(shader);
+    program.Use();
+    glUniformMatrix4fv(program.GetLocation(ShaderProgram::ViewProj), 1, GL_FALSE, &viewProjMtx[0][0]);
+    glUniform1i(program.FindLocation("parts"), parts);
+
+    BoundState::BindVertexArray(VAO);
+    glDrawElementsInstanced(GL_LINES, numIndices, GL_UNSIGNED_SHORT, 0, (GLsizei)instances.size());
+    BoundState::BindVertexArray(0);
+    BoundState::UseProgram(0);
+
+    instances.clear();
+}
+
+void DebugDraw::Submit(RenderQueue& queue, GLuint shader) {
+    if (instances.empty()) return;
+    UploadInstances();
+
+    RenderQueue::Packet packet;
+    packet.program = shader;
+    packet.vertexArray = VAO;
+    packet.draw = &DebugDraw::DrawPacket;
+    packet.object = this;
+    packet.args = glm::ivec4((int)instances.size(), parts, 0, 0);
+    queue.Submit(RenderQueue::MakeKey(RenderQueue::Debug, shader, VAO), packet);
+
+    instances.clear();
+}
+
+void DebugDraw::UploadInstances() {
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(JointInstance), instances.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DebugDraw::DrawPacket(const RenderQueue::Packet& packet) {
+    const DebugDraw* debugDraw = (const DebugDraw*)packet.object;
+    glUniform1i(ShaderProgram::Get(packet.program).FindLocation("parts"), packet.args.y);
+    glDrawElementsInstanced(GL_LINES, debugDraw->numIndices, GL_UNSIGNED_SHORT, 0, packet.args.x);
+}
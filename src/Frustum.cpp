@@ -0,0 +1,74 @@
+#include "Frustum.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE 1
+#include <emmintrin.h>
+#endif
+
+void TransformBox(const glm::mat4& m, const glm::vec3& center, const glm::vec3& extent, glm::vec3& outCenter,
+    glm::vec3& outExtent) {
+    outCenter = glm::vec3(m * glm::vec4(center, 1.0f));
+    outExtent = glm::abs(glm::vec3(m[0])) * extent.x + glm::abs(glm::vec3(m[1])) * extent.y +
+                glm::abs(glm::vec3(m[2])) * extent.z;
+}
+
+Frustum::Frustum(const glm::mat4& viewProjMtx) {
+    // Clip space: -w <= x, y, z <= w, i.e. row3 +/- row0..2 >= 0
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++) {
+        rows[r] = glm::vec4(viewProjMtx[0][r], viewProjMtx[1][r], viewProjMtx[2][r], viewProjMtx[3][r]);
+    }
+    for (int r = 0; r < 3; r++) {
+        planes[2 * r] = rows[3] + rows[r];
+        planes[2 * r + 1] = rows[3] - rows[r];
+    }
+}
+
+bool Frustum::IsVisible(const glm::vec3& center, const glm::vec3& extent) const {
+    // Outside a plane when even the box corner furthest along its normal is
+    // behind it
+    for (const glm::vec4& p : planes) {
+        glm::vec3 n(p);
+        if (glm::dot(n, center) + p.w + glm::dot(glm::abs(n), extent) < 0.0f) return false;
+    }
+    return true;
+}
+
+void Frustum::Cull(const BoundingBoxes& boxes, int begin, int end, unsigned char* visible) const {
+    int i = begin;
+#ifdef FRUSTUM_SSE
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], d[6];
+    for (int p = 0; p < 6; p++) {
+        nx[p] = _mm_set1_ps(planes[p].x);
+        ny[p] = _mm_set1_ps(planes[p].y);
+        nz[p] = _mm_set1_ps(planes[p].z);
+        ax[p] = _mm_and_ps(nx[p], signMask);
+        ay[p] = _mm_and_ps(ny[p], signMask);
+        az[p] = _mm_and_ps(nz[p], signMask);
+        d[p] = _mm_set1_ps(planes[p].w);
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&boxes.cx[i]), cy = _mm_loadu_ps(&boxes.cy[i]), cz = _mm_loadu_ps(&boxes.cz[i]);
+        __m128 ex = _mm_loadu_ps(&boxes.ex[i]), ey = _mm_loadu_ps(&boxes.ey[i]), ez = _mm_loadu_ps(&boxes.ez[i]);
+
+        // Lanes set in 'outside' are behind at least one plane
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                _mm_add_ps(_mm_mul_ps(nz[p], cz), d[p]));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; k++) visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+    }
+#endif
+    for (; i < end; i++) {
+        glm::vec3 center(boxes.cx[i], boxes.cy[i], boxes.cz[i]);
+        glm::vec3 extent(boxes.ex[i], boxes.ey[i], boxes.ez[i]);
+        visible[i] = IsVisible(center, extent) ? 1 : 0;
+    }
+}
@@ -0,0 +1,192 @@
+#include "GpuAnimator.h"
+#include "Shader.h"
+#include "ShaderProgram.h"
+#include <algorithm>
+
+GpuAnimator::GpuAnimator() {
+    numBones = 0;
+    numJoints = 0;
+    inverseBindBase = 0;
+    rootChannels = glm::ivec3(-1);
+    capacity = 0;
+    maxInstances = 0;
+    program = 0;
+    VAO = 0;
+    timeBuffer = 0;
+    keyBuffer = keyTexture = 0;
+    channelBuffer = channelTexture = 0;
+    jointBuffer = jointTexture = 0;
+    jointDataBuffer = jointDataTexture = 0;
+    paletteBuffer = paletteTexture = 0;
+}
+
+GpuAnimator::~GpuAnimator() {
+    Destroy();
+}
+
+void GpuAnimator::Destroy() {
+    GLuint buffers[] = { timeBuffer, keyBuffer, channelBuffer, jointBuffer, jointDataBuffer, paletteBuffer };
+    GLuint textures[] = { keyTexture, channelTexture, jointTexture, jointDataTexture, paletteTexture };
+    glDeleteBuffers(6, buffers);
+    glDeleteTextures(5, textures);
+    BoundState::DeleteVertexArray(VAO);
+    glDeleteProgram(program);
+
+    program = 0;
+    VAO = 0;
+    timeBuffer = 0;
+    keyBuffer = keyTexture = 0;
+    channelBuffer = channelTexture = 0;
+    jointBuffer = jointTexture = 0;
+    jointDataBuffer = jointDataTexture = 0;
+    paletteBuffer = paletteTexture = 0;
+    capacity = 0;
+}
+
+GLuint GpuAnimator::CreateTextureBuffer(GLuint& buffer, GLenum format, const void* data, size_t size) {
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    // Zero sized buffers can't back a texture, so keep at least one texel
+    glBufferData(GL_TEXTURE_BUFFER, std::max(size, sizeof(glm::vec4)), size ? data : nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return texture;
+}
+
+bool GpuAnimator::Load(const Animation& animation, const AnimationBinding& binding, const SkeletonDefinition& def,
+    const Skin& skin) {
+    Destroy();
+
+    const char* varyings[] = { "PaletteRow0", "PaletteRow1", "PaletteRow2" };
+    program = LoadTransformFeedbackShader("shaders/animate.vert", varyings, 3);
+    if (!program) return false;
+
+    // Keys and channels as compiled
+    std::vector<glm::ivec4> channelTable;
+    std::vector<glm::vec4> keyTable;
+    animation.Compile(channelTable, keyTable);
+
+    // The binding's float slots back to channels: root translation, then
+    // 3 rotations per joint. Later channels win, as in Animation::Sample.
+    numJoints = def.GetNumJoints();
+    std::vector<int> slotChannel(3 * (numJoints + 1), -1);
+    for (int i = 0; i < (int)binding.channelToValue.size() && i < (int)channelTable.size(); i++) {
+        int slot = binding.channelToValue[i];
+        if (slot >= 0 && slot < (int)slotChannel.size()) slotChannel[slot] = i;
+    }
+    rootChannels = glm::ivec3(slotChannel[0], slotChannel[1], slotChannel[2]);
+
+    // Rig: channels and parent per joint, then offset, rest pose and limits,
+    // then the inverse binds as rows
+    const std::vector<glm::mat4>& inverseBindings = skin.GetInverseBindings();
+    numBones = (int)inverseBindings.size();
+    std::vector<glm::ivec4> jointTable;
+    std::vector<glm::vec4> jointData;
+    for (int j = 0; j < numJoints; j++) {
+        int slot = 3 * (j + 1);
+        jointTable.push_back(glm::ivec4(slotChannel[slot], slotChannel[slot + 1], slotChannel[slot + 2], def.GetParent(j)));
+        jointData.push_back(glm::vec4(def.GetOffset(j), 0.0f));
+        jointData.push_back(glm::vec4(def.GetRestPose(j), 0.0f));
+        jointData.push_back(glm::vec4(def.GetLimitMin(j), 0.0f));
+        jointData.push_back(glm::vec4(def.GetLimitMax(j), 0.0f));
+    }
+    inverseBindBase = (int)jointData.size();
+    for (const glm::mat4& m : inverseBindings) {
+        for (int r = 0; r < 3; r++) jointData.push_back(glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]));
+    }
+
+    keyTexture = CreateTextureBuffer(keyBuffer, GL_RGBA32F, keyTable.data(), keyTable.size() * sizeof(glm::vec4));
+    channelTexture = CreateTextureBuffer(channelBuffer, GL_RGBA32I, channelTable.data(),
+        channelTable.size() * sizeof(glm::ivec4));
+    jointTexture = CreateTextureBuffer(jointBuffer, GL_RGBA32I, jointTable.data(), jointTable.size() * sizeof(glm::ivec4));
+    jointDataTexture = CreateTextureBuffer(jointDataBuffer, GL_RGBA32F, jointData.data(),
+        jointData.size() * sizeof(glm::vec4));
+
+    // Times are the only vertex input: one float per instance (Loc 0)
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &timeBuffer);
+    BoundState::BindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, timeBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+    glVertexAttribDivisor(0, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    BoundState::BindVertexArray(0);
+
+    // None of the uniforms change after this, so they're set once
+    const ShaderProgram& reflected = ShaderProgram::Get(program);
+    reflected.Use();
+    glUniform1i(reflected.FindLocation("keys"), 0);
+    glUniform1i(reflected.FindLocation("channels"), 1);
+    glUniform1i(reflected.FindLocation("joints"), 2);
+    glUniform1i(reflected.FindLocation("jointData"), 3);
+    glUniform1i(reflected.FindLocation("numJoints"), numJoints);
+    glUniform1i(reflected.FindLocation("inverseBindBase"), inverseBindBase);
+    glUniform3iv(reflected.FindLocation("rootChannels"), 1, &rootChannels[0]);
+    BoundState::UseProgram(0);
+
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    maxInstances = std::max(1, maxTexels / std::max(GetPaletteTexels(), 1));
+    return true;
+}
+
+void GpuAnimator::Evaluate(const float* times, int count) {
+    count = std::min(count, maxInstances);
+    if (count <= 0 || !program || numBones == 0) return;
+
+    // The palette buffer only grows (by doubling) and is reused every frame
+    if (count > capacity) {
+        capacity = std::min(std::max(count, 2 * capacity), maxInstances);
+        if (!paletteBuffer) glGenBuffers(1, &paletteBuffer);
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, paletteBuffer);
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, (GLsizeiptr)capacity * GetPaletteTexels() * sizeof(glm::vec4),
+            nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+
+        if (!paletteTexture) glGenTextures(1, &paletteTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, paletteBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, timeBuffer);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(float), times, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    BoundState::UseProgram(program);
+
+    GLuint textures[] = { keyTexture, channelTexture, jointTexture, jointDataTexture };
+    for (int i = 0; i < 4; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    }
+
+    // One point per bone per character; transform feedback captures in
+    // instance order, so character i's rows land at i * numBones
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, paletteBuffer);
+    BoundState::BindVertexArray(VAO);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArraysInstanced(GL_POINTS, 0, numBones, count);
+    glEndTransformFeedback();
+    BoundState::BindVertexArray(0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    for (int i = 3; i >= 0; i--) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    BoundState::UseProgram(0);
+}
+
+void GpuAnimator::Bind(GLuint textureUnit) const {
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+}
@@ -90,8 +90,8 @@ bool Joint::Load(Tokenizer& tokenizer) {
         }
     }
 
-    // Initialize geometry
-    geometry = new Cube(boxmin, boxmax);
+    // Geometry is created on first Draw, so the tree can be loaded without
+    // a GL context (e.g. when it is only flattened into a SkeletonDefinition)
 
     return true;
 }
@@ -120,10 +120,9 @@ void Joint::Update(const glm::mat4& parentWorldMtx) {
 }
 
 void Joint::Draw(const glm::mat4& viewProjMtx, GLuint shader) {
-    if (geometry) {
-        geometry->setModel(WorldMtx);
-        geometry->draw(viewProjMtx, shader);
-    }
+    if (!geometry) geometry = new Cube(boxmin, boxmax);
+    geometry->setModel(WorldMtx);
+    geometry->draw(viewProjMtx, shader);
 
     for (auto c : children) {
         c->Draw(viewProjMtx, shader);
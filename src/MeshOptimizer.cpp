@@ -0,0 +1,373 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <tuple>
+
+float ComputeACMR(const std::vector<unsigned int>& indices, int numVerts, int cacheSize) {
+    int numTris = (int)indices.size() / 3;
+    if (numTris == 0) return 0.0f;
+
+    // FIFO: a hit does not refresh the entry. cachedAt[v] is the miss
+    // counter value when v was inserted.
+    std::vector<int> cachedAt(numVerts, -cacheSize - 1);
+    int misses = 0;
+    for (unsigned int v : indices) {
+        if (misses - cachedAt[v] > cacheSize) {
+            cachedAt[v] = misses;
+            misses++;
+        }
+    }
+    return (float)misses / numTris;
+}
+
+namespace {
+
+// Forsyth's scoring constants for a 32 entry LRU model
+const int CacheSize = 32;
+const float CacheDecayPower = 1.5f;
+const float LastTriScore = 0.75f;
+const float ValenceBoostScale = 2.0f;
+const float ValenceBoostPower = 0.5f;
+
+float VertexScore(int cachePosition, int remainingTris) {
+    if (remainingTris == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // The last triangle's vertices: using them again right away is
+            // good, but not as good as rotating in a neighbour
+            score = LastTriScore;
+        }
+        else {
+            float scaler = 1.0f / (CacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, CacheDecayPower);
+        }
+    }
+
+    // Favour vertices with few triangles left so they are finished off
+    // and do not strand lone triangles for later
+    score += ValenceBoostScale * std::pow((float)remainingTris, -ValenceBoostPower);
+    return score;
+}
+
+}
+
+void OptimizeVertexCache(std::vector<unsigned int>& indices, int numVerts) {
+    int numTris = (int)indices.size() / 3;
+    if (numTris == 0) return;
+
+    // Vertex -> triangle adjacency, CSR
+    std::vector<int> adjStart(numVerts + 1, 0);
+    for (unsigned int v : indices) adjStart[v + 1]++;
+    for (int v = 0; v < numVerts; v++) adjStart[v + 1] += adjStart[v];
+    std::vector<int> adjTris(indices.size());
+    std::vector<int> fill(adjStart.begin(), adjStart.end() - 1);
+    for (int t = 0; t < numTris; t++) {
+        for (int k = 0; k < 3; k++) adjTris[fill[indices[t * 3 + k]]++] = t;
+    }
+
+    // Remaining (not yet emitted) triangles stay at the front of each list
+    std::vector<int> remaining(numVerts);
+    std::vector<int> cachePos(numVerts, -1);
+    std::vector<float> vertScore(numVerts);
+    for (int v = 0; v < numVerts; v++) {
+        remaining[v] = adjStart[v + 1] - adjStart[v];
+        vertScore[v] = VertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> triScore(numTris);
+    std::vector<char> emitted(numTris, 0);
+    for (int t = 0; t < numTris; t++) {
+        triScore[t] = vertScore[indices[t * 3]] + vertScore[indices[t * 3 + 1]] + vertScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+
+    // LRU cache, with room for the 3 vertices pushed in before trimming
+    std::vector<int> cache, newCache;
+    cache.reserve(CacheSize + 3);
+    newCache.reserve(CacheSize + 3);
+
+    int nextUnemitted = 0;
+    int best = 0;
+    for (int t = 1; t < numTris; t++) {
+        if (triScore[t] > triScore[best]) best = t;
+    }
+
+    while (best >= 0) {
+        emitted[best] = 1;
+        const unsigned int* tri = &indices[best * 3];
+        for (int k = 0; k < 3; k++) output.push_back(tri[k]);
+
+        // Remove the triangle from its vertices' remaining lists
+        for (int k = 0; k < 3; k++) {
+            int v = tri[k];
+            int* list = &adjTris[adjStart[v]];
+            for (int i = 0; i < remaining[v]; i++) {
+                if (list[i] == best) {
+                    std::swap(list[i], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // Move its vertices to the front of the cache
+        newCache.assign(tri, tri + 3);
+        for (int v : cache) {
+            if (v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2]) newCache.push_back(v);
+        }
+        for (size_t i = CacheSize; i < newCache.size(); i++) {
+            int v = newCache[i]; // fell out
+            cachePos[v] = -1;
+            vertScore[v] = VertexScore(-1, remaining[v]);
+        }
+        if ((int)newCache.size() > CacheSize) newCache.resize(CacheSize);
+        cache.swap(newCache);
+
+        // Rescore the cached vertices and pick the best triangle touching
+        // them; nothing else changed score
+        for (int i = 0; i < (int)cache.size(); i++) {
+            cachePos[cache[i]] = i;
+        }
+        for (int v : cache) {
+            vertScore[v] = VertexScore(cachePos[v], remaining[v]);
+        }
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (int v : cache) {
+            for (int i = 0; i < remaining[v]; i++) {
+                int t = adjTris[adjStart[v] + i];
+                const unsigned int* n = &indices[t * 3];
+                triScore[t] = vertScore[n[0]] + vertScore[n[1]] + vertScore[n[2]];
+                if (triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (best < 0) {
+            // Nothing left next to the cache: start the next disconnected
+            // piece at the first triangle not yet emitted
+            while (nextUnemitted < numTris && emitted[nextUnemitted]) nextUnemitted++;
+            if (nextUnemitted < numTris) best = nextUnemitted;
+        }
+    }
+
+    indices.swap(output);
+}
+
+void OptimizeVertexFetch(std::vector<unsigned int>& indices, int numVerts, std::vector<int>& remap) {
+    remap.assign(numVerts, -1);
+    int next = 0;
+    for (unsigned int& v : indices) {
+        if (remap[v] < 0) remap[v] = next++;
+        v = remap[v];
+    }
+    for (int v = 0; v < numVerts; v++) {
+        if (remap[v] < 0) remap[v] = next++;
+    }
+}
+
+namespace {
+
+// Symmetric 4x4 error quadric, upper triangle
+struct Quadric {
+    double a[10];
+
+    Quadric() { for (int i = 0; i < 10; i++) a[i] = 0.0; }
+
+    // Squared distance to the plane n.p + d = 0
+    static Quadric FromPlane(const glm::dvec3& n, double d) {
+        Quadric q;
+        q.a[0] = n.x * n.x; q.a[1] = n.x * n.y; q.a[2] = n.x * n.z; q.a[3] = n.x * d;
+        q.a[4] = n.y * n.y; q.a[5] = n.y * n.z; q.a[6] = n.y * d;
+        q.a[7] = n.z * n.z; q.a[8] = n.z * d;
+        q.a[9] = d * d;
+        return q;
+    }
+
+    void Add(const Quadric& q) { for (int i = 0; i < 10; i++) a[i] += q.a[i]; }
+
+    double Error(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+                 + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+                 + a[7] * z * z + 2 * a[8] * z
+                 + a[9];
+        return e > 0.0 ? e : 0.0;
+    }
+};
+
+struct Collapse {
+    double cost;
+    int from, to;
+    int stamp;
+    bool operator<(const Collapse& c) const { return cost > c.cost; } // min-heap
+};
+
+}
+
+float SimplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+    int targetTriangles, float maxError, const std::function<bool(int, int)>& canCollapse, std::vector<unsigned int>& result) {
+    int numVerts = (int)positions.size();
+    int numTris = (int)indices.size() / 3;
+    std::vector<int> tris(indices.begin(), indices.begin() + numTris * 3);
+    std::vector<char> triAlive(numTris, 1);
+    std::vector<std::vector<int>> vertTris(numVerts);
+    for (int t = 0; t < numTris; t++) {
+        for (int k = 0; k < 3; k++) vertTris[tris[t * 3 + k]].push_back(t);
+    }
+
+    // Plane quadrics, summed per vertex
+    std::vector<Quadric> quadrics(numVerts);
+    for (int t = 0; t < numTris; t++) {
+        glm::dvec3 p0 = positions[tris[t * 3]], p1 = positions[tris[t * 3 + 1]], p2 = positions[tris[t * 3 + 2]];
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double len = glm::length(n);
+        if (len <= 0.0) continue;
+        n /= len;
+        Quadric q = Quadric::FromPlane(n, -glm::dot(n, p0));
+        for (int k = 0; k < 3; k++) quadrics[tris[t * 3 + k]].Add(q);
+    }
+
+    // Lock open borders (an edge used once) and seams (a position shared
+    // by several vertices, e.g. split normals); moving either would tear
+    // the surface
+    std::vector<char> locked(numVerts, 0);
+    {
+        std::map<std::pair<int, int>, int> edgeUse;
+        for (int t = 0; t < numTris; t++) {
+            for (int k = 0; k < 3; k++) {
+                int a = tris[t * 3 + k], b = tris[t * 3 + (k + 1) % 3];
+                edgeUse[std::make_pair(std::min(a, b), std::max(a, b))]++;
+            }
+        }
+        for (auto& e : edgeUse) {
+            if (e.second == 1) locked[e.first.first] = locked[e.first.second] = 1;
+        }
+
+        std::map<std::tuple<float, float, float>, int> firstAt;
+        for (int v = 0; v < numVerts; v++) {
+            auto key = std::make_tuple(positions[v].x, positions[v].y, positions[v].z);
+            auto it = firstAt.find(key);
+            if (it == firstAt.end()) {
+                firstAt[key] = v;
+            }
+            else {
+                locked[v] = locked[it->second] = 1;
+            }
+        }
+    }
+
+    std::vector<int> stamp(numVerts, 0);
+    std::vector<char> vertAlive(numVerts, 1);
+    std::priority_queue<Collapse> queue;
+
+    auto neighbours = [&](int v, std::vector<int>& out) {
+        out.clear();
+        for (int t : vertTris[v]) {
+            for (int k = 0; k < 3; k++) {
+                int n = tris[t * 3 + k];
+                if (n != v && std::find(out.begin(), out.end(), n) == out.end()) out.push_back(n);
+            }
+        }
+    };
+    auto push = [&](int from, int to) {
+        if (locked[from] || !canCollapse(from, to)) return;
+        queue.push(Collapse{ quadrics[from].Error(positions[to]), from, to, stamp[from] });
+    };
+
+    std::vector<int> around, aroundTo;
+    for (int v = 0; v < numVerts; v++) {
+        neighbours(v, around);
+        for (int n : around) push(v, n);
+    }
+
+    int liveTris = numTris;
+    double errorLimit = (double)maxError * maxError;
+    double usedError = 0.0;
+    while (liveTris > targetTriangles && !queue.empty()) {
+        Collapse c = queue.top();
+        queue.pop();
+        int u = c.from, v = c.to;
+        if (!vertAlive[u] || !vertAlive[v] || c.stamp != stamp[u]) continue;
+        if (c.cost > errorLimit) break;
+
+        // Still an edge, and collapsing it keeps the surface manifold: u and
+        // v may only share the two vertices opposite their edge
+        neighbours(u, around);
+        if (std::find(around.begin(), around.end(), v) == around.end()) continue;
+        neighbours(v, aroundTo);
+        int shared = 0;
+        for (int n : around) {
+            if (std::find(aroundTo.begin(), aroundTo.end(), n) != aroundTo.end()) shared++;
+        }
+        if (shared > 2) continue;
+
+        // Reject collapses that flip or squash a surviving triangle
+        bool flips = false;
+        for (int t : vertTris[u]) {
+            int* tri = &tris[t * 3];
+            if (tri[0] == v || tri[1] == v || tri[2] == v) continue;
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = positions[tri[k]];
+                q[k] = tri[k] == u ? positions[v] : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.1f * glm::length(before) * glm::length(after)) {
+                flips = true;
+                break;
+            }
+        }
+        if (flips) continue;
+
+        // Collapse u onto v
+        for (int t : vertTris[u]) {
+            int* tri = &tris[t * 3];
+            if (tri[0] == v || tri[1] == v || tri[2] == v) {
+                triAlive[t] = 0;
+                liveTris--;
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                if (tri[k] == u) tri[k] = v;
+            }
+            vertTris[v].push_back(t);
+        }
+        vertTris[u].clear();
+        vertAlive[u] = 0;
+        quadrics[v].Add(quadrics[u]);
+        stamp[v]++;
+        usedError = std::max(usedError, c.cost);
+
+        std::vector<int>& vt = vertTris[v];
+        vt.erase(std::remove_if(vt.begin(), vt.end(), [&](int t) { return !triAlive[t]; }), vt.end());
+        for (int n : around) {
+            std::vector<int>& nt = vertTris[n];
+            nt.erase(std::remove_if(nt.begin(), nt.end(), [&](int t) { return !triAlive[t]; }), nt.end());
+        }
+
+        // v's quadric changed, and u's neighbours now border v
+        neighbours(v, aroundTo);
+        for (int n : aroundTo) {
+            push(v, n);
+            push(n, v);
+        }
+    }
+
+    result.clear();
+    for (int t = 0; t < numTris; t++) {
+        if (!triAlive[t]) continue;
+        for (int k = 0; k < 3; k++) result.push_back(tris[t * 3 + k]);
+    }
+    return (float)std::sqrt(usedError);
+}
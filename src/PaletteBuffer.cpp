@@ -0,0 +1,167 @@
+#include "PaletteBuffer.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+PaletteBuffer::PaletteBuffer(int numRegions) {
+    this->numRegions = std::max(1, std::min(numRegions, 8));
+    regionCapacity = 0;
+    maxCapacity = 0;
+    region = 0;
+    cursor = 0;
+    persistent = false;
+    mapped = nullptr;
+    pendingUnmap = false;
+    buffer = 0;
+    texture = 0;
+    for (int i = 0; i < 8; i++) fences[i] = 0;
+}
+
+PaletteBuffer::~PaletteBuffer() {
+    Destroy();
+    if (texture) glDeleteTextures(1, &texture);
+}
+
+void PaletteBuffer::Create(int capacity) {
+    // GL objects are made on first use, so this needs a current context
+    if (!texture) {
+        glGenTextures(1, &texture);
+    }
+
+    regionCapacity = std::min(capacity, GetMaxCapacity());
+    GLsizeiptr size = (GLsizeiptr)regionCapacity * numRegions * sizeof(glm::mat4);
+
+    persistent = GLEW_ARB_buffer_storage != 0;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    if (persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_TEXTURE_BUFFER, size, nullptr, flags);
+        mapped = (glm::mat4*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, size, flags);
+        if (!mapped) {
+            // Storage is immutable now, so fall back on a fresh buffer
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            persistent = false;
+        }
+    }
+    if (!persistent) {
+        glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        mapped = nullptr;
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+int PaletteBuffer::GetMaxCapacity() {
+    if (!maxCapacity) {
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        maxCapacity = std::max(1, maxTexels / 4 / numRegions);
+    }
+    return maxCapacity;
+}
+
+void PaletteBuffer::Destroy() {
+    for (int i = 0; i < numRegions; i++) {
+        WaitRegion(i);
+    }
+    if (buffer) {
+        if (persistent || pendingUnmap) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            glUnmapBuffer(GL_TEXTURE_BUFFER);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+    pendingUnmap = false;
+    regionCapacity = 0;
+}
+
+void PaletteBuffer::WaitRegion(int r) {
+    if (!fences[r]) return;
+    // Only blocks if the GPU is a full ring behind
+    GLenum result = glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (result == GL_TIMEOUT_EXPIRED) {
+        result = glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+    }
+    glDeleteSync(fences[r]);
+    fences[r] = 0;
+}
+
+void PaletteBuffer::BeginFrame() {
+    region = (region + 1) % numRegions;
+    cursor = 0;
+    WaitRegion(region);
+}
+
+void PaletteBuffer::EndFrame() {
+    if (fences[region]) glDeleteSync(fences[region]);
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+glm::mat4* PaletteBuffer::Allocate(int count, int& baseTexel) {
+    if (count <= 0) return nullptr;
+
+    if (cursor + count > regionCapacity) {
+        if (count > GetMaxCapacity()) {
+            std::cerr << "PaletteBuffer: " << count << " matrices exceeds the texture buffer limit of "
+                      << maxCapacity << std::endl;
+            return nullptr;
+        }
+        // Grow (doubling) and restart this frame in the new buffer. Draws
+        // already issued this frame keep reading the old storage.
+        Destroy();
+        Create(std::max(std::max(regionCapacity * 2, cursor + count), 256));
+        cursor = 0;
+        if (count > regionCapacity) return nullptr;
+    }
+
+    int first = region * regionCapacity + cursor;
+    cursor += count;
+    baseTexel = first * 4;
+
+    if (persistent) {
+        return mapped + first;
+    }
+
+    // No persistent mapping: map just this block. The fence already
+    // guarantees the GPU is done with it, so skip driver synchronization.
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    mapped = (glm::mat4*)glMapBufferRange(GL_TEXTURE_BUFFER, first * sizeof(glm::mat4), count * sizeof(glm::mat4),
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    pendingUnmap = mapped != nullptr;
+    return mapped;
+}
+
+void PaletteBuffer::Commit() {
+    // Coherent persistent writes need nothing; otherwise unmap the block
+    if (!pendingUnmap) return;
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glUnmapBuffer(GL_TEXTURE_BUFFER);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    pendingUnmap = false;
+    mapped = nullptr;
+}
+
+int PaletteBuffer::Upload(const glm::mat4* matrices, int count) {
+    int base = -1;
+    glm::mat4* dst = Allocate(count, base);
+    if (!dst) return -1;
+    memcpy(dst, matrices, count * sizeof(glm::mat4));
+    Commit();
+    return base;
+}
+
+void PaletteBuffer::Bind(GLuint textureUnit) const {
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+}
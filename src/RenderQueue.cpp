@@ -0,0 +1,73 @@
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Not a GL name, so the first packet always counts as a change
+const GLuint None = ~0u;
+
+}
+
+uint64_t RenderQueue::MakeKey(int layer, GLuint program, GLuint vertexArray, float depth) {
+    // Non-negative floats sort like their bits; the top 28 are plenty
+    uint32_t depthBits;
+    depth = std::max(depth, 0.0f);
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+    return ((uint64_t)(layer & 0xF) << 60) | ((uint64_t)(program & 0xFFFF) << 44) |
+           ((uint64_t)(vertexArray & 0xFFFF) << 28) | (depthBits >> 3);
+}
+
+void RenderQueue::Submit(uint64_t key, const Packet& packet) {
+    order.push_back(std::make_pair(key, (int)packets.size()));
+    packets.push_back(packet);
+}
+
+void RenderQueue::OnExecuted(Callback callback, void* object) {
+    callbacks.push_back(std::make_pair(callback, object));
+}
+
+void RenderQueue::Execute() {
+    stats = Stats();
+    stats.packets = (int)packets.size();
+
+    GLuint program = None, vertexArray = None;
+    for (const Packet& packet : packets) {
+        if (packet.program != program) stats.unsortedProgramChanges++;
+        if (packet.vertexArray != vertexArray) stats.unsortedVertexArrayChanges++;
+        program = packet.program;
+        vertexArray = packet.vertexArray;
+    }
+
+    // The index breaks ties, so equal keys keep submission order
+    std::sort(order.begin(), order.end());
+
+    program = vertexArray = None;
+    for (const std::pair<uint64_t, int>& entry : order) {
+        const Packet& packet = packets[entry.second];
+        if (packet.program != program) {
+            const ShaderProgram& reflected = ShaderProgram::Get(packet.program);
+            reflected.Use();
+            glUniformMatrix4fv(reflected.GetLocation(ShaderProgram::ViewProj), 1, GL_FALSE, &viewProj[0][0]);
+            program = packet.program;
+            stats.programChanges++;
+        }
+        if (packet.vertexArray != vertexArray) {
+            BoundState::BindVertexArray(packet.vertexArray);
+            vertexArray = packet.vertexArray;
+            stats.vertexArrayChanges++;
+        }
+        packet.draw(packet);
+    }
+
+    // Once per pass, so a later glBindBuffer(GL_ELEMENT_ARRAY_BUFFER) can't
+    // land in the last packet's vertex array. The program stays bound.
+    if (!order.empty()) BoundState::BindVertexArray(0);
+
+    for (const std::pair<Callback, void*>& callback : callbacks) callback.first(callback.second);
+
+    packets.clear();
+    order.clear();
+    callbacks.clear();
+}
@@ -1,81 +1,178 @@
 #include "Shader.h"
+#include "ShaderProgram.h"
+#include "EmbeddedShaders.h"
+#include <cstdint>
+#include <sstream>
+#include <thread>
 
-enum ShaderType { 
+enum ShaderType {
 	vertex,
-	fragment 
+	fragment
 };
 
-GLuint LoadSingleShader(const char* shaderFilePath, ShaderType type) {
-    // Create a shader id.
-    GLuint shaderID = 0;
-    if (type == vertex)
-        shaderID = glCreateShader(GL_VERTEX_SHADER);
-    else if (type == fragment)
-        shaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Try to read shader codes from the shader file.
-    std::string shaderCode;
-    std::ifstream shaderStream(shaderFilePath, std::ios::in);
-    if (shaderStream.is_open()) {
-        std::string Line = "";
-        while (getline(shaderStream, Line))
-            shaderCode += "\n" + Line;
-        shaderStream.close();
+namespace {
+
+// Linked programs are saved here (a directory in the working directory,
+// created by the build next to the copied shaders). Without it nothing is
+// cached and every start compiles.
+const char* const CacheDirectory = "shadercache";
+
+// Compile and link issued, nothing checked yet
+struct PendingProgram {
+    GLuint program;
+    GLuint shaders[2];
+    int numShaders;
+    std::string name; // shader paths, for messages
+    uint64_t key; // binary cache entry
+    bool cached; // loaded from the cache rather than compiled
+};
+
+std::vector<PendingProgram> pendingPrograms;
+bool requestFailed = false;
+
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+    // FNV-1a
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t HashString(uint64_t hash, const std::string& s) {
+    // Length included, so "ab" + "c" and "a" + "bc" differ
+    uint64_t length = s.size();
+    hash = HashBytes(hash, &length, sizeof(length));
+    return HashBytes(hash, s.data(), s.size());
+}
+
+// A binary only loads on the driver that wrote it
+const std::string& GetDriverString() {
+    static std::string driver;
+    if (driver.empty()) {
+        GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : names) {
+            const GLubyte* s = glGetString(name);
+            driver += s ? (const char*)s : "?";
+            driver += "\n";
+        }
+    }
+    return driver;
+}
+
+// Binary formats the driver accepts; none means no caching
+const std::vector<GLint>& GetBinaryFormats() {
+    static std::vector<GLint> formats;
+    static bool queried = false;
+    if (!queried && GLEW_ARB_get_program_binary) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+        formats.resize(count);
+        if (count > 0) glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+    }
+    queried = true;
+    return formats;
+}
+
+bool SupportsProgramBinary() {
+    return !GetBinaryFormats().empty();
+}
+
+std::string GetCachePath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+    return CacheDirectory + std::string(name);
+}
+
+// File layout: binary format (GLenum), then the driver's blob
+bool LoadCachedProgram(GLuint program, uint64_t key) {
+    if (!SupportsProgramBinary()) return false;
+    std::ifstream file(GetCachePath(key), std::ios::binary);
+    if (!file.is_open()) return false;
+
+    GLenum format = 0;
+    file.read((char*)&format, sizeof(format));
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) return false;
+    // A format glProgramBinary doesn't know would only raise an error
+    const std::vector<GLint>& formats = GetBinaryFormats();
+    if (std::find(formats.begin(), formats.end(), (GLint)format) == formats.end()) return false;
+
+    glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+    return true;
+}
+
+void SaveCachedProgram(GLuint program, uint64_t key) {
+    if (!SupportsProgramBinary()) return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    std::ofstream file(GetCachePath(key), std::ios::binary);
+    if (!file.is_open()) return; // no cache directory: just don't cache
+    file.write((const char*)&format, sizeof(format));
+    file.write(binary.data(), length);
+}
+
+// Embedded copy first, then the file, with 'defines' after #version
+bool ReadShaderSource(const char* shaderFilePath, const char* defines, std::string& shaderCode) {
+    std::istringstream embedded;
+    std::ifstream file;
+    std::istream* shaderStream = &file;
+    if (const char* source = FindEmbeddedShader(shaderFilePath)) {
+        embedded.str(source);
+        shaderStream = &embedded;
     } else {
-        std::cerr << "Impossible to open " << shaderFilePath << ". "
-                  << "Check to make sure the file exists and you passed in the "
-                  << "right filepath!"
-                  << std::endl;
-        return 0;
+        file.open(shaderFilePath, std::ios::in);
+        if (!file.is_open()) {
+            std::cerr << "Impossible to open " << shaderFilePath << ". "
+                      << "Check to make sure the file exists and you passed in the "
+                      << "right filepath!"
+                      << std::endl;
+            return false;
+        }
     }
 
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
+    std::string Line = "";
+    while (getline(*shaderStream, Line)) {
+        if (!Line.empty() && Line.back() == '\r') Line.pop_back();
+        shaderCode += "\n" + Line;
+        // Defines have to come after #version
+        if (defines && Line.compare(0, 8, "#version") == 0) shaderCode += "\n" + std::string(defines);
+    }
+    return true;
+}
 
-    // Compile Shader.
-    std::cerr << "Compiling shader: " << shaderFilePath << std::endl;
+GLuint CompileShader(const std::string& shaderCode, ShaderType type) {
+    GLuint shaderID = glCreateShader(type == vertex ? GL_VERTEX_SHADER : GL_FRAGMENT_SHADER);
     char const* sourcePointer = shaderCode.c_str();
     glShaderSource(shaderID, 1, &sourcePointer, NULL);
     glCompileShader(shaderID);
+    return shaderID;
+}
 
-    // Check Shader.
-    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &Result);
+// Any info log counts as a failure, so shaders have to build warning-free
+bool CheckShader(GLuint shaderID) {
+    int InfoLogLength;
     glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
     if (InfoLogLength > 0) {
         std::vector<char> shaderErrorMessage(InfoLogLength + 1);
         glGetShaderInfoLog(shaderID, InfoLogLength, NULL, shaderErrorMessage.data());
         std::string msg(shaderErrorMessage.begin(), shaderErrorMessage.end());
         std::cerr << msg << std::endl;
-        return 0;
-    } else {
-        if (type == vertex)
-            printf("Successfully compiled vertex shader!\n");
-        else if (type == fragment)
-            printf("Successfully compiled fragment shader!\n");
+        return false;
     }
-
-    return shaderID;
+    return true;
 }
 
-GLuint LoadShaders(const char* vertexFilePath, const char* fragmentFilePath) {
-    // Create the vertex shader and fragment shader.
-    GLuint vertexShaderID = LoadSingleShader(vertexFilePath, vertex);
-    GLuint fragmentShaderID = LoadSingleShader(fragmentFilePath, fragment);
-
-    // Check both shaders.
-    if (vertexShaderID == 0 || fragmentShaderID == 0) return 0;
-
+bool CheckProgram(GLuint programID) {
     GLint Result = GL_FALSE;
     int InfoLogLength;
-
-    // Link the program.
-    printf("Linking program\n");
-    GLuint programID = glCreateProgram();
-    glAttachShader(programID, vertexShaderID);
-    glAttachShader(programID, fragmentShaderID);
-    glLinkProgram(programID);
-
-    // Check the program.
     glGetProgramiv(programID, GL_LINK_STATUS, &Result);
     glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &InfoLogLength);
     if (InfoLogLength > 0) {
@@ -83,17 +180,152 @@ GLuint LoadShaders(const char* vertexFilePath, const char* fragmentFilePath) {
         glGetProgramInfoLog(programID, InfoLogLength, NULL, ProgramErrorMessage.data());
         std::string msg(ProgramErrorMessage.begin(), ProgramErrorMessage.end());
         std::cerr << msg << std::endl;
-        glDeleteProgram(programID);
-        return 0;
+        return false;
+    }
+    return Result == GL_TRUE;
+}
+
+// Compiles and links without waiting for either; FinishShaders checks
+void BuildProgram(PendingProgram& pending, const char* const* paths, const std::string* sources,
+    const ShaderType* types, int numShaders, const char* const* varyings, int numVaryings) {
+    pending.numShaders = numShaders;
+    for (int i = 0; i < numShaders; i++) {
+        std::cerr << "Compiling shader: " << paths[i] << std::endl;
+        pending.shaders[i] = CompileShader(sources[i], types[i]);
+        glAttachShader(pending.program, pending.shaders[i]);
+    }
+    // The varyings have to be declared before linking
+    if (numVaryings > 0) glTransformFeedbackVaryings(pending.program, numVaryings, varyings, GL_INTERLEAVED_ATTRIBS);
+    if (SupportsProgramBinary()) glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pending.program);
+}
+
+GLuint RequestProgram(const char* const* paths, const ShaderType* types, int numShaders, const char* const* varyings,
+    int numVaryings, const char* defines) {
+    // Let the driver compile on its own threads where it can
+    static bool threadsSet = false;
+    if (!threadsSet && GLEW_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    threadsSet = true;
+
+    // Everything that decides the linked result goes into the key
+    std::string sources[2];
+    uint64_t key = HashString(14695981039346656037ull, GetDriverString());
+    for (int i = 0; i < numShaders; i++) {
+        if (!ReadShaderSource(paths[i], defines, sources[i])) {
+            requestFailed = true;
+            return 0;
+        }
+        key = HashBytes(key, &types[i], sizeof(types[i]));
+        key = HashString(key, sources[i]);
+    }
+    for (int i = 0; i < numVaryings; i++) key = HashString(key, varyings[i]);
+
+    PendingProgram pending;
+    pending.program = glCreateProgram();
+    pending.numShaders = 0;
+    pending.key = key;
+    pending.cached = LoadCachedProgram(pending.program, key);
+    pending.name = paths[0];
+    for (int i = 1; i < numShaders; i++) pending.name += std::string(" ") + paths[i];
+
+    // A cached binary can still be refused (e.g. a driver update the strings
+    // didn't show); then it is built from source after all
+    if (pending.cached) {
+        GLint linked = GL_FALSE;
+        glGetProgramiv(pending.program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(pending.program);
+            pending.program = glCreateProgram();
+            pending.cached = false;
+        }
+    }
+    if (!pending.cached) BuildProgram(pending, paths, sources, types, numShaders, varyings, numVaryings);
+    pendingPrograms.push_back(pending);
+    return pending.program;
+}
+
+bool IsComplete(const PendingProgram& pending) {
+    if (!GLEW_ARB_parallel_shader_compile || pending.cached) return true;
+    GLint complete = GL_TRUE;
+    glGetProgramiv(pending.program, GL_COMPLETION_STATUS_ARB, &complete);
+    return complete == GL_TRUE;
+}
+
+bool FinishProgram(PendingProgram& pending) {
+    bool ok = true;
+    for (int i = 0; i < pending.numShaders; i++) ok = CheckShader(pending.shaders[i]) && ok;
+    ok = ok && CheckProgram(pending.program);
+
+    for (int i = 0; i < pending.numShaders; i++) {
+        glDetachShader(pending.program, pending.shaders[i]);
+        glDeleteShader(pending.shaders[i]);
+    }
+    if (!ok) {
+        std::cerr << "Failed to build " << pending.name << std::endl;
+        return false;
+    }
+
+    if (pending.cached) {
+        printf("Loaded cached program: %s\n", pending.name.c_str());
     } else {
-        printf("Successfully linked program!\n");
+        printf("Successfully linked program: %s\n", pending.name.c_str());
+        SaveCachedProgram(pending.program, pending.key);
+    }
+
+    // Uniform locations once, instead of by name on every draw
+    ShaderProgram::Reflect(pending.program);
+    return true;
+}
+
+}
+
+GLuint RequestShaders(const char* vertexFilePath, const char* fragmentFilePath, const char* defines) {
+    const char* paths[] = { vertexFilePath, fragmentFilePath };
+    ShaderType types[] = { vertex, fragment };
+    return RequestProgram(paths, types, 2, nullptr, 0, defines);
+}
+
+GLuint RequestTransformFeedbackShader(const char* vertexFilePath, const char* const* varyings, int numVaryings,
+    const char* defines) {
+    ShaderType type = vertex;
+    return RequestProgram(&vertexFilePath, &type, 1, varyings, numVaryings, defines);
+}
+
+bool FinishShaders() {
+    bool ok = !requestFailed;
+    requestFailed = false;
+
+    // Check them as they complete rather than in order, so saving and
+    // reflecting one overlaps the compiles still running
+    std::vector<PendingProgram> pending;
+    pending.swap(pendingPrograms);
+    while (!pending.empty()) {
+        bool progress = false;
+        for (size_t i = 0; i < pending.size();) {
+            if (!IsComplete(pending[i])) {
+                i++;
+                continue;
+            }
+            ok = FinishProgram(pending[i]) && ok;
+            pending.erase(pending.begin() + i);
+            progress = true;
+        }
+        if (!progress) std::this_thread::yield();
     }
+    return ok;
+}
 
-    // Detach and delete the shaders as they are no longer needed.
-    glDetachShader(programID, vertexShaderID);
-    glDetachShader(programID, fragmentShaderID);
-    glDeleteShader(vertexShaderID);
-    glDeleteShader(fragmentShaderID);
+GLuint LoadShaders(const char* vertexFilePath, const char* fragmentFilePath, const char* defines) {
+    GLuint programID = RequestShaders(vertexFilePath, fragmentFilePath, defines);
+    if (FinishShaders()) return programID;
+    glDeleteProgram(programID);
+    return 0;
+}
 
-    return programID;
+GLuint LoadTransformFeedbackShader(const char* vertexFilePath, const char* const* varyings, int numVaryings,
+    const char* defines) {
+    GLuint programID = RequestTransformFeedbackShader(vertexFilePath, varyings, numVaryings, defines);
+    if (FinishShaders()) return programID;
+    glDeleteProgram(programID);
+    return 0;
 }
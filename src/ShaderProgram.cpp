@@ -0,0 +1,127 @@
+#include "ShaderProgram.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Uniform names in ShaderProgram::Uniform order
+const char* const UniformNames[ShaderProgram::NumUniforms] = {
+    "viewProj", "model", "DiffuseColor", "boneMatrices", "boneBase", "normalBase", "boneFormat", "instanceStride" };
+
+// Indexed by GL program name, which drivers hand out small and dense
+std::vector<ShaderProgram> programs;
+
+// BoundState before anything is bound through it: no GL object has this
+// name, so the first bind always goes through
+const GLuint Unknown = ~0u;
+
+}
+
+ShaderProgram::ShaderProgram() {
+    id = 0;
+    for (GLint& location : locations) location = -1;
+}
+
+const ShaderProgram& ShaderProgram::Reflect(GLuint program) {
+    if (program >= programs.size()) programs.resize(program + 1);
+    ShaderProgram& reflected = programs[program];
+    reflected = ShaderProgram();
+    reflected.id = program;
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(std::max(maxLength, 1) + 1);
+    for (GLint i = 0; i < count; i++) {
+        UniformInfo info;
+        GLsizei length = 0;
+        glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &info.size, &info.type, name.data());
+        info.location = glGetUniformLocation(program, name.data());
+        info.name.assign(name.data(), length);
+        if (info.name.size() > 3 && info.name.compare(info.name.size() - 3, 3, "[0]") == 0) {
+            info.name.resize(info.name.size() - 3);
+        }
+        reflected.uniforms.push_back(info);
+    }
+    std::sort(reflected.uniforms.begin(), reflected.uniforms.end(),
+        [](const UniformInfo& a, const UniformInfo& b) { return a.name < b.name; });
+
+    count = 0;
+    maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    name.resize(std::max(maxLength, 1) + 1);
+    for (GLint i = 0; i < count; i++) {
+        BlockInfo info;
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(program, (GLuint)i, (GLsizei)name.size(), &length, name.data());
+        info.name.assign(name.data(), length);
+        info.index = (GLuint)i;
+        glGetActiveUniformBlockiv(program, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &info.dataSize);
+        reflected.blocks.push_back(info);
+    }
+    std::sort(reflected.blocks.begin(), reflected.blocks.end(),
+        [](const BlockInfo& a, const BlockInfo& b) { return a.name < b.name; });
+
+    for (int u = 0; u < NumUniforms; u++) {
+        reflected.locations[u] = reflected.FindLocation(UniformNames[u]);
+    }
+    return reflected;
+}
+
+const ShaderProgram& ShaderProgram::Get(GLuint program) {
+    static const ShaderProgram none;
+    if (program >= programs.size() || programs[program].id != program) return none;
+    return programs[program];
+}
+
+GLint ShaderProgram::FindLocation(const char* name) const {
+    auto it = std::lower_bound(uniforms.begin(), uniforms.end(), name,
+        [](const UniformInfo& info, const char* key) { return strcmp(info.name.c_str(), key) < 0; });
+    if (it == uniforms.end() || it->name != name) return -1;
+    return it->location;
+}
+
+void ShaderProgram::Use() const {
+    BoundState::UseProgram(id);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BoundState
+////////////////////////////////////////////////////////////////////////////////
+
+GLuint BoundState::program = Unknown;
+GLuint BoundState::vertexArray = Unknown;
+BoundState::Stats BoundState::stats;
+
+void BoundState::UseProgram(GLuint program) {
+    if (program == BoundState::program) {
+        stats.programSkips++;
+        return;
+    }
+    glUseProgram(program);
+    BoundState::program = program;
+    stats.programBinds++;
+}
+
+void BoundState::BindVertexArray(GLuint vao) {
+    if (vao == vertexArray) {
+        stats.vertexArraySkips++;
+        return;
+    }
+    glBindVertexArray(vao);
+    vertexArray = vao;
+    stats.vertexArrayBinds++;
+}
+
+void BoundState::DeleteVertexArray(GLuint& vao) {
+    if (!vao) return;
+    if (vao == vertexArray) vertexArray = 0;
+    glDeleteVertexArrays(1, &vao);
+    vao = 0;
+}
+
+void BoundState::Reset() {
+    program = Unknown;
+    vertexArray = Unknown;
+}
@@ -0,0 +1,157 @@
+#include "SkeletonDefinition.h"
+#include <algorithm>
+
+SkeletonDefinition::SkeletonDefinition() {
+}
+
+SkeletonDefinition::~SkeletonDefinition() {
+    Clear();
+}
+
+void SkeletonDefinition::Clear() {
+    for (auto g : geometry) {
+        delete g;
+    }
+    geometry.clear();
+
+    parents.clear();
+    children.clear();
+    names.clear();
+    nameToIndex.clear();
+    depths.clear();
+    subtreeEnd.clear();
+    updateSpine.clear();
+    updateTasks.clear();
+    innerJoints.clear();
+    offsets.clear();
+    boxMin.clear();
+    boxMax.clear();
+    restPose.clear();
+    limitMin.clear();
+    limitMax.clear();
+    restLocal.clear();
+}
+
+bool SkeletonDefinition::Load(const char* filename, bool createGeometry) {
+    // Reuse the tree parser, then flatten it. The temporary tree never draws,
+    // so it never creates any GL objects.
+    Skeleton skeleton;
+    if (!skeleton.Load(filename) || !skeleton.GetRoot()) {
+        return false;
+    }
+    Build(skeleton, createGeometry);
+    return true;
+}
+
+void SkeletonDefinition::Build(Skeleton& skeleton, bool createGeometry) {
+    Clear();
+
+    const std::vector<Joint*>& joints = skeleton.jointList;
+    int numJoints = (int)joints.size();
+
+    std::unordered_map<Joint*, int> indexOf;
+    for (int i = 0; i < numJoints; i++) {
+        indexOf[joints[i]] = i;
+    }
+
+    parents.assign(numJoints, -1);
+    children.resize(numJoints);
+    names.resize(numJoints);
+    offsets.resize(numJoints);
+    boxMin.resize(numJoints);
+    boxMax.resize(numJoints);
+    restPose.resize(numJoints);
+    limitMin.resize(numJoints);
+    limitMax.resize(numJoints);
+
+    for (int i = 0; i < numJoints; i++) {
+        Joint* j = joints[i];
+        names[i] = j->GetName();
+        nameToIndex.emplace(names[i], i); // first joint wins on duplicate names
+        offsets[i] = j->GetOffset();
+        boxMin[i] = j->GetBoxMin();
+        boxMax[i] = j->GetBoxMax();
+        restPose[i] = j->GetPose();
+
+        glm::vec2 lx = j->GetRotXLimit();
+        glm::vec2 ly = j->GetRotYLimit();
+        glm::vec2 lz = j->GetRotZLimit();
+        limitMin[i] = glm::vec3(lx.x, ly.x, lz.x);
+        limitMax[i] = glm::vec3(lx.y, ly.y, lz.y);
+
+        for (Joint* c : j->GetChildren()) {
+            int ci = indexOf[c];
+            parents[ci] = i;
+            children[i].push_back(ci);
+        }
+    }
+
+    // Parents come first in DFS order, so depth can be filled forwards and
+    // subtree extents backwards
+    depths.assign(numJoints, 0);
+    subtreeEnd.resize(numJoints);
+    for (int i = 0; i < numJoints; i++) {
+        if (parents[i] >= 0) depths[i] = depths[parents[i]] + 1;
+    }
+    for (int i = numJoints - 1; i >= 0; i--) {
+        subtreeEnd[i] = children[i].empty() ? i + 1 : subtreeEnd[children[i].back()];
+    }
+
+    BuildUpdateSchedule();
+
+    restLocal.resize(numJoints);
+    for (int i = 0; i < numJoints; i++) {
+        if (parents[i] < 0 || !children[i].empty()) innerJoints.push_back(i);
+        restLocal[i] = ComputeLocalMatrix(i, offsets[i], restPose[i]);
+    }
+
+    if (createGeometry) {
+        geometry.resize(numJoints);
+        for (int i = 0; i < numJoints; i++) {
+            geometry[i] = new Cube(boxMin[i], boxMax[i]);
+        }
+    }
+}
+
+int SkeletonDefinition::FindJoint(const std::string& name) const {
+    auto it = nameToIndex.find(name);
+    return it == nameToIndex.end() ? -1 : it->second;
+}
+
+void SkeletonDefinition::BuildUpdateSchedule() {
+    int numJoints = GetNumJoints();
+    if (numJoints == 0) return;
+
+    // Split until subtrees are small enough to give plenty of tasks per
+    // thread (for load balancing), but big enough to amortize scheduling
+    const int grain = std::max(256, numJoints / 256);
+
+    std::vector<int> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+        int j = stack.back();
+        stack.pop_back();
+
+        if (subtreeEnd[j] - j <= grain) {
+            updateTasks.push_back(glm::ivec2(j, subtreeEnd[j]));
+            continue;
+        }
+
+        // Too big: this joint becomes part of the serial spine. Push the
+        // children in reverse so the spine stays in DFS order.
+        updateSpine.push_back(j);
+        for (auto it = children[j].rbegin(); it != children[j].rend(); ++it) {
+            stack.push_back(*it);
+        }
+    }
+}
+
+glm::mat4 SkeletonDefinition::ComputeLocalMatrix(int j, const glm::vec3& offset, const glm::vec3& pose) const {
+    glm::vec3 curPose = glm::clamp(pose, limitMin[j], limitMax[j]);
+
+    glm::mat4 local = glm::translate(glm::mat4(1.0f), offset);
+    local = glm::rotate(local, curPose.z, glm::vec3(0, 0, 1));
+    local = glm::rotate(local, curPose.y, glm::vec3(0, 1, 0));
+    local = glm::rotate(local, curPose.x, glm::vec3(1, 0, 0));
+    return local;
+}
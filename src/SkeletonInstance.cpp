@@ -0,0 +1,111 @@
+#include "SkeletonInstance.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+SkeletonInstance::SkeletonInstance(const SkeletonDefinition* def) {
+    definition = def;
+    pose.Resize(def->GetNumJoints());
+    worldMtx.assign(def->GetNumJoints(), glm::mat4(1.0f));
+    worldVersion.assign(def->GetNumJoints(), 0);
+    chainScratch.reserve(64);
+    ResetPose();
+}
+
+void SkeletonInstance::ResetPose() {
+    MarkPoseChanged();
+    int numJoints = definition->GetNumJoints();
+    if (numJoints == 0) return;
+
+    pose.RootTranslation() = definition->GetOffset(0);
+    for (int j = 0; j < numJoints; j++) {
+        pose.Rotation(j) = definition->GetRestPose(j);
+    }
+}
+
+void SkeletonInstance::Update() {
+    int numJoints = definition->GetNumJoints();
+    if (numJoints >= parallelThreshold && ThreadPool::Get().GetNumThreads() > 1) {
+        UpdateParallel();
+    } else {
+        // DFS order guarantees the parent is already done when we reach a child
+        UpdateRange(0, numJoints);
+    }
+
+    // Every joint is current now
+    std::fill(worldVersion.begin(), worldVersion.end(), poseVersion);
+}
+
+void SkeletonInstance::UpdateInnerJoints() {
+    // Inner joints come in DFS order too, so parents are still done first
+    const std::vector<int>& inner = definition->GetInnerJoints();
+    for (int j : inner) UpdateJoint(j);
+    int numJoints = definition->GetNumJoints();
+    for (int j = 0; j < numJoints; j++) {
+        if (!definition->GetChildren(j).empty() || definition->GetParent(j) < 0) continue;
+        worldMtx[j] = worldMtx[definition->GetParent(j)] * definition->GetRestLocalMatrix(j);
+    }
+
+    // The leaves don't match the pose, so joint queries must recompute them
+    for (int j : inner) worldVersion[j] = poseVersion;
+}
+
+const glm::mat4& SkeletonInstance::EvaluateJoint(int j) {
+    // Walk up until we hit an ancestor that is already current (or the root)
+    chainScratch.clear();
+    for (int k = j; k >= 0 && worldVersion[k] != poseVersion; k = definition->GetParent(k)) {
+        chainScratch.push_back(k);
+    }
+
+    // Then compute back down, parent first
+    for (auto it = chainScratch.rbegin(); it != chainScratch.rend(); ++it) {
+        UpdateJoint(*it);
+        worldVersion[*it] = poseVersion;
+    }
+    return worldMtx[j];
+}
+
+void SkeletonInstance::EvaluateJoints(const int* joints, int count) {
+    for (int i = 0; i < count; i++) {
+        EvaluateJoint(joints[i]);
+    }
+}
+
+void SkeletonInstance::UpdateJoint(int j) {
+    int parent = definition->GetParent(j);
+    if (parent < 0) {
+        worldMtx[j] = definition->ComputeLocalMatrix(j, pose.RootTranslation(), pose.Rotation(j));
+    } else {
+        worldMtx[j] = worldMtx[parent] * definition->ComputeLocalMatrix(j, definition->GetOffset(j), pose.Rotation(j));
+    }
+}
+
+void SkeletonInstance::UpdateRange(int begin, int end) {
+    for (int j = begin; j < end; j++) {
+        UpdateJoint(j);
+    }
+}
+
+void SkeletonInstance::UpdateParallel() {
+    // The spine is the small top of the tree above the task subtrees
+    for (int j : definition->GetUpdateSpine()) {
+        UpdateJoint(j);
+    }
+
+    // Each task is a contiguous DFS range covering one whole subtree, so the
+    // only cross-task dependency is the spine, which is already done. The
+    // tasks write disjoint parts of worldMtx and need no other sync.
+    const std::vector<glm::ivec2>& tasks = definition->GetUpdateTasks();
+    ThreadPool::Get().ParallelFor((int)tasks.size(), [&](int i) {
+        UpdateRange(tasks[i].x, tasks[i].y);
+    });
+}
+
+void SkeletonInstance::Draw(const glm::mat4& viewProjMtx, GLuint shader) {
+    int numJoints = definition->GetNumJoints();
+    for (int j = 0; j < numJoints; j++) {
+        Cube* geometry = definition->GetGeometry(j);
+        if (!geometry) continue;
+        geometry->setModel(worldMtx[j]);
+        geometry->draw(viewProjMtx, shader);
+    }
+}
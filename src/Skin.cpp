@@ -1,16 +1,85 @@
 #include "Skin.h"
+#include "SkinPalette.h"
+#include "MeshOptimizer.h"
+#include "ShaderProgram.h"
+#include "Frustum.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/quaternion.hpp>
+
+namespace {
+
+// Packs a unit normal as signed normalized 10-10-10-2 (GL_INT_2_10_10_10_REV)
+GLuint PackNormal(const glm::vec3& n) {
+    glm::vec3 c = glm::clamp(n, -1.0f, 1.0f);
+    GLuint x = (GLuint)(int)std::lround(c.x * 511.0f) & 0x3FF;
+    GLuint y = (GLuint)(int)std::lround(c.y * 511.0f) & 0x3FF;
+    GLuint z = (GLuint)(int)std::lround(c.z * 511.0f) & 0x3FF;
+    return x | (y << 10) | (z << 20);
+}
+
+// Quantizes up to 8 normalized weights to unorm8 so they sum to exactly
+// 255 (largest remainder), so the shader's blend stays affine
+void QuantizeWeights(const float* weights, int count, unsigned char* out) {
+    int q[8] = {0};
+    float rem[8];
+    int total = 0;
+    for (int k = 0; k < count; k++) {
+        float scaled = weights[k] * 255.0f;
+        q[k] = (int)scaled;
+        rem[k] = scaled - q[k];
+        total += q[k];
+    }
+    while (count > 0 && total < 255) {
+        int best = 0;
+        for (int k = 1; k < count; k++) {
+            if (rem[k] > rem[best]) best = k;
+        }
+        q[best]++;
+        rem[best] = -1.0f;
+        total++;
+    }
+    for (int k = 0; k < count; k++) out[k] = (unsigned char)q[k];
+}
+
+// Shader variant for a vertex with 'count' influences: 0..3 for 1/2/4/8
+int InfluenceClass(int count) {
+    if (count <= 1) return 0;
+    if (count == 2) return 1;
+    if (count <= 4) return 2;
+    return 3;
+}
+
+}
 
 Skin::Skin() {
     VAO = 0;
+    VBO = 0;
+    VBO_extra = 0;
+    EBO = 0;
+    numExtraVertices = 0;
+    extraVertexStride = 8;
+    for (int c = 0; c < NumInfluenceClasses; c++) classFirstVertex[c] = classEndVertex[c] = 0;
+    paletteVersion = 0;
+    rigidBones = false;
+    paletteFormat = PaletteAffine3x4;
+    indexType = GL_UNSIGNED_INT;
+    forcedLod = -1;
+    currentLod = 0;
+    boundRadius = 0.0f;
+    worldBoundCenter = worldBoundExtent = glm::vec3(0.0f);
+    maxInfluences = 8;
+    vertexStride = 0;
+    boneIndexType = GL_UNSIGNED_BYTE;
 }
 
 Skin::~Skin() {
-    glDeleteBuffers(1, &VBO_pos);
-    glDeleteBuffers(1, &VBO_norm);
-    glDeleteBuffers(1, &VBO_weights);
-    glDeleteBuffers(1, &VBO_ids);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &VBO_extra);
     glDeleteBuffers(1, &EBO);
-    glDeleteVertexArrays(1, &VAO);
+    BoundState::DeleteVertexArray(VAO);
 }
 
 bool Skin::Load(const char* filename) {
@@ -24,15 +93,10 @@ bool Skin::Load(const char* filename) {
     int numVerts = tokenizer.GetInt();
     tokenizer.GetToken(token); // "{"
     positions.resize(numVerts);
-    skinWeights.resize(numVerts); // Resize weights here too
     for(int i=0; i<numVerts; i++) {
         positions[i].x = tokenizer.GetFloat();
         positions[i].y = tokenizer.GetFloat();
         positions[i].z = tokenizer.GetFloat();
-        
-        // Initialize weights to 0
-        skinWeights[i].weights = glm::vec4(0.0f);
-        skinWeights[i].ids = glm::ivec4(0);
     }
     tokenizer.GetToken(token); // "}"
 
@@ -49,29 +113,39 @@ bool Skin::Load(const char* filename) {
     tokenizer.GetToken(token); // "}"
 
     // READ SKIN WEIGHTS
+    // Build the sparse lists directly: each vertex keeps its largest
+    // maxInfluences attachments (file order is arbitrary), renormalized
     tokenizer.GetToken(token); // "skinweights"
     int numWeights = tokenizer.GetInt(); // Should match numVerts
     tokenizer.GetToken(token); // "{"
+    influenceOffsets.assign(numVerts + 1, 0);
+    influenceJoints.clear();
+    influenceWeights.clear();
+    std::vector<std::pair<float, int>> attachments;
     for(int i=0; i<numWeights; i++) {
         int numAttachments = tokenizer.GetInt();
-        float totalWeight = 0.0f;
-
+        attachments.clear();
         for(int j=0; j<numAttachments; j++) {
             int jointID = tokenizer.GetInt();
             float weight = tokenizer.GetFloat();
-            
-            // Store only top 4 weights for GPU (GLSL limitation simplifier)
-            if(j < 4) {
-                skinWeights[i].ids[j] = jointID;
-                skinWeights[i].weights[j] = weight;
-                totalWeight += weight;
-            }
+            if (weight > 0.0f) attachments.push_back(std::make_pair(weight, jointID));
         }
-        
-        // Normalize weights after reading all attachments
-        if (totalWeight > 0.0f) {
-            skinWeights[i].weights /= totalWeight; 
+        if (i >= numVerts) continue;
+
+        std::stable_sort(attachments.begin(), attachments.end(),
+            [](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+        if ((int)attachments.size() > maxInfluences) attachments.resize(maxInfluences);
+
+        float totalWeight = 0.0f;
+        for (auto& a : attachments) totalWeight += a.first;
+        for (auto& a : attachments) {
+            influenceJoints.push_back(a.second);
+            influenceWeights.push_back(a.first / totalWeight);
         }
+        influenceOffsets[i + 1] = (int)attachments.size();
+    }
+    for(int i=0; i<numVerts; i++) {
+        influenceOffsets[i + 1] += influenceOffsets[i];
     }
     tokenizer.GetToken(token); // "}"
 
@@ -123,43 +197,79 @@ bool Skin::Load(const char* filename) {
     tokenizer.GetToken(token); // "}"
     tokenizer.Close();
 
+    // The bindings never change after load, so invert them once here
+    // instead of every frame in Update
+    inverseBindings.resize(bindings.size());
+    for(size_t i = 0; i < bindings.size(); i++) {
+        inverseBindings[i] = glm::inverse(bindings[i]);
+    }
+
+    // Rigid binds times a rigid pose stay rigid, so the normal matrices
+    // would only repeat the skin matrices
+    rigidBones = HasRigidBindings();
+
+    OptimizeMesh();
+    BuildLods();
+    BuildBoneBoxes();
+    PartitionVertices();
+
     // --- SETUP BUFFERS ---
+    BuildVertexData();
+
     glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    BoundState::BindVertexArray(VAO);
+
+    // One interleaved stream, see BuildVertexData for the layout
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
 
-    // Positions (Loc 0)
-    glGenBuffers(1, &VBO_pos);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_pos);
-    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+    // Position (Loc 0)
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertexStride, (void*)0);
 
-    // Normals (Loc 1)
-    glGenBuffers(1, &VBO_norm);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_norm);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
+    // Normal (Loc 1), 10-10-10-2 snorm
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexStride, (void*)12);
 
-    // Weights (Loc 2)
-    glGenBuffers(1, &VBO_weights);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_weights);
-    glBufferData(GL_ARRAY_BUFFER, skinWeights.size() * sizeof(VertexBoneData), skinWeights.data(), GL_STATIC_DRAW);
+    // Weights (Loc 2), unorm8
     glEnableVertexAttribArray(2);
-    // Offset 0 of struct
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(VertexBoneData), (void*)0);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, vertexStride, (void*)16);
 
-    // Bone Indices (Loc 3)
+    // Bone Indices (Loc 3), uint8 or uint16
     // Note: use glVertexAttribIPointer for Integers!
     glEnableVertexAttribArray(3);
-    glVertexAttribIPointer(3, 4, GL_INT, sizeof(VertexBoneData), (void*)sizeof(glm::vec4));
+    glVertexAttribIPointer(3, 4, boneIndexType, vertexStride, (void*)20);
+
+    // Influences 5-8 (Loc 4, 5), only for the leading vertices that 8-bone
+    // triangles use. Enabled just around those draws, see Draw.
+    if (numExtraVertices > 0) {
+        glGenBuffers(1, &VBO_extra);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_extra);
+        glBufferData(GL_ARRAY_BUFFER, extraVertexData.size(), extraVertexData.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, extraVertexStride, (void*)0);
+        glVertexAttribIPointer(5, 4, boneIndexType, extraVertexStride, (void*)4);
+    }
 
-    // EBO
+    // EBO: every LOD's indices back to back, all into the same vertices
+    std::vector<unsigned int> allIndices;
+    for (const LodLevel& lod : lods) {
+        allIndices.insert(allIndices.end(), lod.indices.begin(), lod.indices.end());
+    }
     glGenBuffers(1, &EBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    if (positions.size() <= 65536) {
+        // 16-bit indices halve index fetch bandwidth
+        std::vector<unsigned short> shortIndices(allIndices.begin(), allIndices.end());
+        indexType = GL_UNSIGNED_SHORT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+    }
+    else {
+        indexType = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, allIndices.size() * sizeof(unsigned int), allIndices.data(), GL_STATIC_DRAW);
+    }
 
-    glBindVertexArray(0);
+    BoundState::BindVertexArray(0);
     
     // Initialize skinning matrices to identity for bind pose rendering
     // (when no skeleton is loaded)
@@ -167,10 +277,348 @@ bool Skin::Load(const char* filename) {
     for(size_t i = 0; i < skinningMatrices.size(); i++) {
         skinningMatrices[i] = glm::mat4(1.0f);
     }
+    UpdateBounds(nullptr, 0);
+    PackPalette();
     
     return true;
 }
 
+void Skin::OptimizeMesh() {
+    int numVerts = (int)positions.size();
+    for (unsigned int i : indices) {
+        if (i >= (unsigned int)numVerts) {
+            std::cerr << "Skin: triangle index " << i << " out of range, skipping mesh optimization" << std::endl;
+            return;
+        }
+    }
+
+    // Triangle order for the post-transform cache: every miss re-runs the
+    // full bone blend for that vertex
+    float acmrBefore = ComputeACMR(indices, numVerts);
+    OptimizeVertexCache(indices, numVerts);
+    float acmrAfter = ComputeACMR(indices, numVerts);
+    std::cout << "Skin: " << indices.size() / 3 << " triangles, ACMR " << acmrBefore << " -> " << acmrAfter << std::endl;
+
+    // Then vertex order for fetch locality. Every per-vertex array follows.
+    std::vector<int> remap;
+    OptimizeVertexFetch(indices, numVerts, remap);
+
+    RemapVertices(remap);
+}
+
+void Skin::RemapVertices(const std::vector<int>& remap) {
+    int numVerts = (int)positions.size();
+
+    std::vector<glm::vec3> newPositions(numVerts);
+    for (int v = 0; v < numVerts; v++) newPositions[remap[v]] = positions[v];
+    positions.swap(newPositions);
+
+    if ((int)normals.size() == numVerts) {
+        std::vector<glm::vec3> newNormals(numVerts);
+        for (int v = 0; v < numVerts; v++) newNormals[remap[v]] = normals[v];
+        normals.swap(newNormals);
+    }
+
+    std::vector<int> newOffsets(numVerts + 1, 0);
+    for (int v = 0; v < numVerts; v++) {
+        newOffsets[remap[v] + 1] = influenceOffsets[v + 1] - influenceOffsets[v];
+    }
+    for (int v = 0; v < numVerts; v++) newOffsets[v + 1] += newOffsets[v];
+    std::vector<int> newJoints(influenceJoints.size());
+    std::vector<float> newWeights(influenceWeights.size());
+    for (int v = 0; v < numVerts; v++) {
+        int dst = newOffsets[remap[v]];
+        for (int k = influenceOffsets[v]; k < influenceOffsets[v + 1]; k++, dst++) {
+            newJoints[dst] = influenceJoints[k];
+            newWeights[dst] = influenceWeights[k];
+        }
+    }
+    influenceOffsets.swap(newOffsets);
+    influenceJoints.swap(newJoints);
+    influenceWeights.swap(newWeights);
+}
+
+int Skin::GetInfluenceClass(int v) const {
+    return InfluenceClass(influenceOffsets[v + 1] - influenceOffsets[v]);
+}
+
+void Skin::PartitionTriangles(LodLevel& lod) const {
+    // A triangle needs the variant of its widest vertex
+    std::vector<unsigned int> byClass[NumInfluenceClasses];
+    for (size_t t = 0; t < lod.indices.size(); t += 3) {
+        int c = 0;
+        for (int k = 0; k < 3; k++) c = std::max(c, GetInfluenceClass(lod.indices[t + k]));
+        byClass[c].insert(byClass[c].end(), lod.indices.begin() + t, lod.indices.begin() + t + 3);
+    }
+
+    lod.indices.clear();
+    for (int c = 0; c < NumInfluenceClasses; c++) {
+        OptimizeVertexCache(byClass[c], (int)positions.size());
+        lod.classStart[c] = (int)lod.indices.size();
+        lod.indices.insert(lod.indices.end(), byClass[c].begin(), byClass[c].end());
+    }
+    lod.classStart[NumInfluenceClasses] = (int)lod.indices.size();
+}
+
+void Skin::PartitionVertices() {
+    int numVerts = (int)positions.size();
+
+    // Vertices touched by any 8-bone triangle (at any LOD) go first so the
+    // extra influence stream only has to cover them; then 4, 2, 1. Stable,
+    // so the fetch order within each range is kept.
+    std::vector<int> drawClass(numVerts, 0);
+    for (int v = 0; v < numVerts; v++) drawClass[v] = GetInfluenceClass(v);
+    for (const LodLevel& lod : lods) {
+        for (int c = 0; c < NumInfluenceClasses; c++) {
+            for (int i = lod.classStart[c]; i < lod.classStart[c + 1]; i++) {
+                drawClass[lod.indices[i]] = std::max(drawClass[lod.indices[i]], c);
+            }
+        }
+    }
+
+    std::vector<int> remap(numVerts);
+    int next = 0;
+    for (int c = NumInfluenceClasses - 1; c >= 0; c--) {
+        classFirstVertex[c] = next;
+        for (int v = 0; v < numVerts; v++) {
+            if (drawClass[v] == c) remap[v] = next++;
+        }
+        classEndVertex[c] = next;
+        if (c == NumInfluenceClasses - 1) numExtraVertices = next;
+    }
+    RemapVertices(remap);
+
+    for (LodLevel& lod : lods) {
+        for (unsigned int& i : lod.indices) i = remap[i];
+        for (int c = 0; c < NumInfluenceClasses; c++) {
+            lod.classMinVertex[c] = numVerts;
+            lod.classMaxVertex[c] = 0;
+            for (int i = lod.classStart[c]; i < lod.classStart[c + 1]; i++) {
+                lod.classMinVertex[c] = std::min(lod.classMinVertex[c], (int)lod.indices[i]);
+                lod.classMaxVertex[c] = std::max(lod.classMaxVertex[c], (int)lod.indices[i]);
+            }
+        }
+    }
+    indices = lods[0].indices;
+}
+
+bool Skin::SimilarWeights(int a, int b) const {
+    // L1 distance between the two sparse weight vectors (0 = identical,
+    // 2 = disjoint joints)
+    float distance = 0.0f;
+    for (int i = influenceOffsets[a]; i < influenceOffsets[a + 1]; i++) {
+        float other = 0.0f;
+        for (int k = influenceOffsets[b]; k < influenceOffsets[b + 1]; k++) {
+            if (influenceJoints[k] == influenceJoints[i]) other = influenceWeights[k];
+        }
+        distance += std::abs(influenceWeights[i] - other);
+    }
+    for (int k = influenceOffsets[b]; k < influenceOffsets[b + 1]; k++) {
+        bool inA = false;
+        for (int i = influenceOffsets[a]; i < influenceOffsets[a + 1]; i++) {
+            if (influenceJoints[i] == influenceJoints[k]) inA = true;
+        }
+        if (!inA) distance += influenceWeights[k];
+    }
+    return distance <= 0.25f;
+}
+
+void Skin::BuildLods() {
+    // Bounding sphere of the bind pose, for screen size estimates
+    glm::vec3 lo(0.0f), hi(0.0f);
+    if (!positions.empty()) lo = hi = positions[0];
+    for (const glm::vec3& p : positions) {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    boundCenter = 0.5f * (lo + hi);
+    boundRadius = 0.0f;
+    for (const glm::vec3& p : positions) {
+        boundRadius = std::max(boundRadius, glm::length(p - boundCenter));
+    }
+
+    lods.clear();
+    lods.push_back(LodLevel());
+    lods[0].firstIndex = 0;
+    lods[0].indices = indices;
+    lods[0].error = 0.0f;
+    PartitionTriangles(lods[0]);
+
+    // Each level aims for half the previous triangles, within an error
+    // budget (relative to the skin's size) that grows 4x per level. Vertices
+    // only merge onto neighbours with nearly the same skin weights, so the
+    // simplified surface still bends where the full mesh does. All levels
+    // share the vertex buffer.
+    auto canCollapse = [this](int from, int to) { return SimilarWeights(from, to); };
+    for (int level = 1; level < 4; level++) {
+        const std::vector<unsigned int>& previous = lods.back().indices;
+        int target = (int)(previous.size() / 3) / 2;
+        if (target < 8) break;
+
+        LodLevel lod;
+        float maxError = boundRadius * 0.0025f * (float)(1 << (2 * level));
+        lod.error = SimplifyMesh(positions, previous, target, maxError, canCollapse, lod.indices);
+        if (lod.indices.size() > previous.size() * 9 / 10) break; // locked up, not worth a level
+        PartitionTriangles(lod);
+        lod.firstIndex = lods.back().firstIndex + (int)previous.size();
+        lods.push_back(lod);
+    }
+}
+
+bool Skin::HasRigidBindings() const {
+    // Orthogonal columns of equal length: rotation times uniform scale
+    for (const glm::mat4& m : bindings) {
+        glm::vec3 x(m[0]), y(m[1]), z(m[2]);
+        float scale = glm::dot(x, x);
+        float tolerance = 1e-3f * scale;
+        if (scale <= 0.0f || std::abs(glm::dot(y, y) - scale) > tolerance || std::abs(glm::dot(z, z) - scale) > tolerance ||
+            std::abs(glm::dot(x, y)) > tolerance || std::abs(glm::dot(y, z)) > tolerance ||
+            std::abs(glm::dot(z, x)) > tolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Skin::BuildBoneBoxes() {
+    // Each influenced vertex in the space of each of its joints, so the box
+    // only has to be posed by the joint's world matrix
+    int numBones = (int)bindings.size();
+    std::vector<glm::vec3> lo(numBones, glm::vec3(FLT_MAX)), hi(numBones, glm::vec3(-FLT_MAX));
+    for (int v = 0; v < (int)positions.size(); v++) {
+        glm::vec4 p(positions[v], 1.0f);
+        for (int k = influenceOffsets[v]; k < influenceOffsets[v + 1]; k++) {
+            int j = influenceJoints[k];
+            if (j < 0 || j >= numBones || influenceWeights[k] <= 0.0f) continue;
+            glm::vec3 local(inverseBindings[j] * p);
+            lo[j] = glm::min(lo[j], local);
+            hi[j] = glm::max(hi[j], local);
+        }
+    }
+
+    boneBoxes.clear();
+    for (int b = 0; b < numBones; b++) {
+        if (lo[b].x > hi[b].x) continue;
+        BoneBox box;
+        box.bone = b;
+        box.center = 0.5f * (lo[b] + hi[b]);
+        box.extent = 0.5f * (hi[b] - lo[b]);
+        boneBoxes.push_back(box);
+    }
+}
+
+void Skin::ComputeBounds(const glm::mat4* world, int count, glm::vec3& center, glm::vec3& extent) const {
+    if (boneBoxes.empty()) {
+        center = extent = glm::vec3(0.0f);
+        return;
+    }
+    // A skinned vertex is a weighted average of its bones' transforms of it,
+    // each inside that bone's posed box, so it's inside their union
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (const BoneBox& box : boneBoxes) {
+        glm::vec3 c, e;
+        TransformBox(box.bone < count ? world[box.bone] : bindings[box.bone], box.center, box.extent, c, e);
+        lo = glm::min(lo, c - e);
+        hi = glm::max(hi, c + e);
+    }
+    center = 0.5f * (lo + hi);
+    extent = 0.5f * (hi - lo);
+}
+
+void Skin::UpdateBounds(const glm::mat4* world, int count) {
+    ComputeBounds(world, count, worldBoundCenter, worldBoundExtent);
+}
+
+bool Skin::IsCulled(const glm::mat4& viewProjMtx) const {
+    return !boneBoxes.empty() && !Frustum(viewProjMtx).IsVisible(worldBoundCenter, worldBoundExtent);
+}
+
+int Skin::SelectLod(const glm::mat4& viewProjMtx) const {
+    return SelectLod(viewProjMtx, skinningMatrices.empty() ? glm::mat4(1.0f) : skinningMatrices[0]);
+}
+
+int Skin::SelectLod(const glm::mat4& viewProjMtx, const glm::mat4& rootMtx) const {
+    // Projected diameter as a fraction of the viewport height. The length
+    // of the projection's y row is the vertical focal scale (the view part
+    // is a rotation), so this works straight from the combined matrix.
+    glm::vec3 center = glm::vec3(rootMtx * glm::vec4(boundCenter, 1.0f));
+    glm::vec4 row1(viewProjMtx[0][1], viewProjMtx[1][1], viewProjMtx[2][1], viewProjMtx[3][1]);
+    glm::vec4 row3(viewProjMtx[0][3], viewProjMtx[1][3], viewProjMtx[2][3], viewProjMtx[3][3]);
+    float w = glm::dot(row3, glm::vec4(center, 1.0f));
+    if (w <= boundRadius) return 0; // camera inside or very close
+
+    float screenSize = boundRadius * glm::length(glm::vec3(row1)) / w;
+
+    // Full detail above 40% of the screen, then one level per halving
+    int level = 0;
+    for (float threshold = 0.4f; screenSize < threshold && level + 1 < (int)lods.size(); threshold *= 0.5f) {
+        level++;
+    }
+    return level;
+}
+
+void Skin::BuildVertexData() {
+    // Interleaved layout, 24 bytes per vertex (28 with uint16 bone ids):
+    //   0: float3 position
+    //  12: normal, 10-10-10-2 snorm
+    //  16: 4 x unorm8 weights (largest influences first)
+    //  20: 4 x uint8 bone ids, or 4 x uint16 for more than 256 joints
+    // The first numExtraVertices also get 4 more weights + ids in a second
+    // stream. Weights sum to 255 across both.
+    bool shortIds = bindings.size() > 256;
+    boneIndexType = shortIds ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    vertexStride = shortIds ? 28 : 24;
+    extraVertexStride = shortIds ? 12 : 8;
+
+    int numVerts = (int)positions.size();
+    vertexData.assign((size_t)numVerts * vertexStride, 0);
+    extraVertexData.assign((size_t)numExtraVertices * extraVertexStride, 0);
+    for(int i=0; i<numVerts; i++) {
+        unsigned char* v = &vertexData[(size_t)i * vertexStride];
+        memcpy(v, &positions[i], 12);
+
+        GLuint n = PackNormal(i < (int)normals.size() ? normals[i] : glm::vec3(0, 1, 0));
+        memcpy(v + 12, &n, 4);
+
+        // At most 8 weights (4 unless this vertex has the extra stream),
+        // the largest ones, renormalized
+        int slots = i < numExtraVertices ? 8 : 4;
+        int begin = influenceOffsets[i];
+        int count = std::min(influenceOffsets[i + 1] - begin, slots);
+        float w[8] = {0};
+        int ids[8] = {0};
+        float totalWeight = 0.0f;
+        for(int k=0; k<count; k++) {
+            ids[k] = influenceJoints[begin + k];
+            if (ids[k] < 0 || ids[k] >= (int)bindings.size()) {
+                ids[k] = 0; // dangling joint, drop it
+                continue;
+            }
+            w[k] = influenceWeights[begin + k];
+            totalWeight += w[k];
+        }
+        if (totalWeight > 0.0f) {
+            for(int k=0; k<count; k++) w[k] /= totalWeight;
+        }
+        unsigned char q[8] = {0};
+        QuantizeWeights(w, count, q);
+
+        unsigned char* extra = i < numExtraVertices ? &extraVertexData[(size_t)i * extraVertexStride] : nullptr;
+        for(int k=0; k<count; k++) {
+            unsigned char* block = k < 4 ? v + 16 : extra;
+            int slot = k & 3;
+            block[slot] = q[k];
+            if (shortIds) {
+                unsigned short s = (unsigned short)ids[k];
+                memcpy(block + 4 + 2 * slot, &s, 2);
+            }
+            else {
+                block[4 + slot] = (unsigned char)ids[k];
+            }
+        }
+    }
+}
+
 void Skin::Update(Skeleton* skeleton) {
     // If no skeleton, keep identity matrices (bind pose)
     if (!skeleton) return;
@@ -181,37 +629,325 @@ void Skin::Update(Skeleton* skeleton) {
     const auto& joints = skeleton->jointList; // You might need to add a getter to Skeleton.h
     
     skinningMatrices.resize(bindings.size());
+    jointWorldScratch.resize(std::min(joints.size(), bindings.size()));
 
     for(size_t i=0; i < bindings.size(); i++) {
         if(i < joints.size()) {
-            glm::mat4 worldMtx = joints[i]->GetWorldMatrix();
-            glm::mat4 inv_bindingMtx = glm::inverse(bindings[i]);
-            
             // Skin Matrix = World * InverseBind
-            // If bindings are stored as bind pose (not inverse), we need to invert them
-            skinningMatrices[i] = worldMtx * inv_bindingMtx;
+            jointWorldScratch[i] = joints[i]->GetWorldMatrix();
+            skinningMatrices[i] = jointWorldScratch[i] * inverseBindings[i];
         } else {
             skinningMatrices[i] = glm::mat4(1.0f);
         }
     }
+    UpdateBounds(jointWorldScratch.data(), (int)jointWorldScratch.size());
+    PackPalette();
 }
 
-void Skin::Draw(const glm::mat4& viewProjMtx, GLuint shader) {
-    glUseProgram(shader);
-    
-    // Pass ViewProj
-    glUniformMatrix4fv(glGetUniformLocation(shader, "viewProj"), 1, GL_FALSE, &viewProjMtx[0][0]);
-    
-    // Pass Model (Identity)
+void Skin::Update(SkeletonInstance* skeleton) {
+    if (!skeleton) return;
+
+    // Instance world matrices are already contiguous and in binding (DFS)
+    // order, so the whole palette is one pass with no per-joint copies
+    const std::vector<glm::mat4>& world = skeleton->GetWorldMatrices();
+
+    skinningMatrices.resize(bindings.size());
+
+    int count = (int)std::min(world.size(), bindings.size());
+    BuildSkinPalette(world.data(), inverseBindings.data(), count, skinningMatrices.data());
+    for(size_t i = count; i < bindings.size(); i++) {
+        skinningMatrices[i] = glm::mat4(1.0f);
+    }
+    UpdateBounds(world.data(), count);
+    PackPalette();
+}
+
+void Skin::SetRigidBones(bool rigid) {
+    rigidBones = rigid;
+    PackPalette();
+}
+
+void Skin::SetPaletteFormat(PaletteFormat format) {
+    paletteFormat = format;
+    PackPalette();
+}
+
+int Skin::GetBoneTexels() const {
+    return paletteFormat == PaletteMatrix4x4 ? 4 : paletteFormat == PaletteAffine3x4 ? 3 : 2;
+}
+
+int Skin::GetNormalTexelOffset() const {
+    // Dual quaternions are rigid by definition, so normals use their rotation
+    if (rigidBones || paletteFormat == PaletteDualQuaternion) return -1;
+    return GetBoneTexels() * (int)bindings.size();
+}
+
+int Skin::GetPaletteTexels() const {
+    int numBones = (int)bindings.size();
+    return GetBoneTexels() * numBones + (GetNormalTexelOffset() >= 0 ? 3 * numBones : 0);
+}
+
+void Skin::PackPalette() {
+    packScratch.resize(GetPaletteTexels());
+    PackPalette(skinningMatrices.data(), packScratch.data());
+    if (packScratch != paletteTexels) {
+        paletteTexels.swap(packScratch);
+        paletteVersion++;
+    }
+}
+
+void Skin::PackPalette(const glm::mat4* matrices, glm::vec4* out) const {
+    int numBones = (int)bindings.size();
+    for (int i = 0; i < numBones; i++) {
+        const glm::mat4& m = matrices[i];
+        if (paletteFormat == PaletteMatrix4x4) {
+            for (int c = 0; c < 4; c++) *out++ = m[c];
+        } else if (paletteFormat == PaletteAffine3x4) {
+            // Rows of the top 3x4; the bottom row is always (0, 0, 0, 1)
+            for (int r = 0; r < 3; r++) *out++ = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+        } else {
+            // Rotation quaternion, plus dual part 0.5 * t * q for translation t
+            glm::mat3 rot(glm::normalize(glm::vec3(m[0])), glm::normalize(glm::vec3(m[1])),
+                glm::normalize(glm::vec3(m[2])));
+            glm::quat q = glm::normalize(glm::quat_cast(rot));
+            glm::vec3 v(q.x, q.y, q.z), t(m[3]);
+            glm::vec3 dual = 0.5f * (q.w * t + glm::cross(t, v));
+            *out++ = glm::vec4(v, q.w);
+            *out++ = glm::vec4(dual, -0.5f * glm::dot(t, v));
+        }
+    }
+    if (GetNormalTexelOffset() < 0) return;
+
+    // Then each bone's normal matrix as 3 texels (columns)
+    for (int i = 0; i < numBones; i++) {
+        glm::mat3 n = glm::transpose(glm::inverse(glm::mat3(matrices[i])));
+        *out++ = glm::vec4(n[0], 0.0f);
+        *out++ = glm::vec4(n[1], 0.0f);
+        *out++ = glm::vec4(n[2], 0.0f);
+    }
+}
+
+int Skin::UploadPalette() {
+    // The buffer hands out whole mat4 slots (4 texels each)
+    int texels = (int)paletteTexels.size();
+    int boneBase = -1;
+    glm::mat4* dst = paletteBuffer.Allocate((texels + 3) / 4, boneBase);
+    if (!dst) return -1;
+    memcpy((glm::vec4*)dst, paletteTexels.data(), texels * sizeof(glm::vec4));
+    paletteBuffer.Commit();
+    return boneBase;
+}
+
+void Skin::Draw(const glm::mat4& viewProjMtx, const GLuint shaders[NumInfluenceClasses]) {
+    if (IsCulled(viewProjMtx)) return;
+
+    // Stream the palette into this frame's slice of the bone buffer. The
+    // CPU only waits if the GPU is still reading this slice from 3 frames ago.
+    paletteBuffer.BeginFrame();
+    int boneBase = UploadPalette();
+    if (boneBase >= 0) {
+        paletteBuffer.Bind(0);
+
+        currentLod = GetDrawLod(viewProjMtx);
+
+        BoundState::BindVertexArray(VAO);
+        // No instance buffer: the per-instance model matrix reads as identity
+        for (int c = 0; c < 4; c++) {
+            glm::vec4 column(0.0f);
+            column[c] = 1.0f;
+            glVertexAttrib4fv(6 + c, &column[0]);
+        }
+        DrawLod(viewProjMtx, shaders, currentLod, boneBase, 0);
+        BoundState::BindVertexArray(0);
+    }
+    paletteBuffer.EndFrame();
+    BoundState::UseProgram(0);
+}
+
+void Skin::DrawInstanced(const glm::mat4& viewProjMtx, const GLuint shaders[NumInfluenceClasses], int level,
+    int boneBase, GLuint instanceBuffer, int firstInstance, int count) {
+    if (count <= 0) return;
+
+    BoundState::BindVertexArray(VAO);
+    // Model matrix (Loc 6-9), one mat4 per instance
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    for (int c = 0; c < 4; c++) {
+        glEnableVertexAttribArray(6 + c);
+        glVertexAttribPointer(6 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+            (void*)(firstInstance * sizeof(glm::mat4) + c * sizeof(glm::vec4)));
+        glVertexAttribDivisor(6 + c, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    DrawLod(viewProjMtx, shaders, level, boneBase, count);
+    for (int c = 0; c < 4; c++) {
+        glDisableVertexAttribArray(6 + c);
+    }
+    BoundState::BindVertexArray(0);
+    BoundState::UseProgram(0);
+}
+
+void Skin::SetSkinningUniforms(GLuint shader, const glm::mat4& viewProjMtx, int boneBase) const {
+    const ShaderProgram& program = ShaderProgram::Get(shader);
+    program.Use();
+    glUniformMatrix4fv(program.GetLocation(ShaderProgram::ViewProj), 1, GL_FALSE, &viewProjMtx[0][0]);
+    SetPaletteUniforms(program, boneBase);
+}
+
+void Skin::SetPaletteUniforms(const ShaderProgram& program, int boneBase) const {
     glm::mat4 model(1.0f);
-    glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, &model[0][0]);
+    int normalOffset = GetNormalTexelOffset();
+    int normalBase = normalOffset < 0 ? -1 : boneBase + normalOffset;
+
+    glUniformMatrix4fv(program.GetLocation(ShaderProgram::Model), 1, GL_FALSE, &model[0][0]);
+    glUniform1i(program.GetLocation(ShaderProgram::BoneMatrices), 0);
+    glUniform1i(program.GetLocation(ShaderProgram::BoneBase), boneBase);
+    glUniform1i(program.GetLocation(ShaderProgram::NormalBase), normalBase);
+    glUniform1i(program.GetLocation(ShaderProgram::BoneFormat), (int)paletteFormat);
+    glUniform1i(program.GetLocation(ShaderProgram::InstanceStride), GetPaletteTexels());
+}
+
+void Skin::DrawLod(const glm::mat4& viewProjMtx, const GLuint shaders[NumInfluenceClasses], int level,
+    int boneBase, int instanceCount) {
+    const LodLevel& lod = lods[level];
+
+    // Influences 5-8 read as weight 0 wherever their arrays are off
+    glVertexAttrib4f(4, 0.0f, 0.0f, 0.0f, 0.0f);
+    glVertexAttribI4ui(5, 0, 0, 0, 0);
+
+    // One draw per influence count, each with its own shader variant
+    for (int c = 0; c < NumInfluenceClasses; c++) {
+        if (lod.classStart[c + 1] == lod.classStart[c]) continue;
+        SetSkinningUniforms(shaders[c], viewProjMtx, boneBase);
+        DrawClass(level, c, instanceCount);
+    }
+}
+
+void Skin::DrawClass(int level, int c, int instanceCount) const {
+    const LodLevel& lod = lods[level];
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    int count = lod.classStart[c + 1] - lod.classStart[c];
+
+    bool extra = c == NumInfluenceClasses - 1 && numExtraVertices > 0;
+    if (extra) {
+        glEnableVertexAttribArray(4);
+        glEnableVertexAttribArray(5);
+    }
+    void* offset = (void*)((lod.firstIndex + lod.classStart[c]) * indexSize);
+    if (instanceCount > 0) {
+        glDrawElementsInstanced(GL_TRIANGLES, count, indexType, offset, instanceCount);
+    } else {
+        glDrawRangeElements(GL_TRIANGLES, lod.classMinVertex[c], lod.classMaxVertex[c], count, indexType, offset);
+    }
+    if (extra) {
+        glDisableVertexAttribArray(4);
+        glDisableVertexAttribArray(5);
+    }
+}
+
+void Skin::Submit(RenderQueue& queue, const GLuint shaders[NumInfluenceClasses]) {
+    if (IsCulled(queue.GetViewProj())) return;
+
+    // The packets read this frame's slice of the bone buffer, so it's only
+    // fenced once they have all been drawn
+    paletteBuffer.BeginFrame();
+    queue.OnExecuted(&Skin::EndPaletteFrame, this);
+    int boneBase = UploadPalette();
+    if (boneBase < 0 || lods.empty()) return;
+
+    const glm::mat4& viewProjMtx = queue.GetViewProj();
+    currentLod = GetDrawLod(viewProjMtx);
+    glm::mat4 root = skinningMatrices.empty() ? glm::mat4(1.0f) : skinningMatrices[0];
+    float depth = (viewProjMtx * root * glm::vec4(boundCenter, 1.0f)).w;
+
+    RenderQueue::Packet packet;
+    packet.vertexArray = VAO;
+    packet.draw = &Skin::DrawPacket;
+    packet.object = this;
+    const LodLevel& lod = lods[currentLod];
+    for (int c = 0; c < NumInfluenceClasses; c++) {
+        if (lod.classStart[c + 1] == lod.classStart[c]) continue;
+        packet.program = shaders[c];
+        packet.args = glm::ivec4(currentLod, c, boneBase, 0);
+        queue.Submit(RenderQueue::MakeKey(RenderQueue::Opaque, shaders[c], VAO, depth), packet);
+    }
+}
+
+void Skin::DrawPacket(const RenderQueue::Packet& packet) {
+    const Skin* skin = (const Skin*)packet.object;
+    skin->paletteBuffer.Bind(0);
+    skin->SetPaletteUniforms(ShaderProgram::Get(packet.program), packet.args.z);
+
+    // Generic attribute values aren't vertex array state, and other
+    // packets may have changed them: identity model, no extra influences
+    for (int c = 0; c < 4; c++) {
+        glm::vec4 column(0.0f);
+        column[c] = 1.0f;
+        glVertexAttrib4fv(6 + c, &column[0]);
+    }
+    glVertexAttrib4f(4, 0.0f, 0.0f, 0.0f, 0.0f);
+    glVertexAttribI4ui(5, 0, 0, 0, 0);
+    skin->DrawClass(packet.args.x, packet.args.y, 0);
+}
+
+void Skin::EndPaletteFrame(void* skin) {
+    ((Skin*)skin)->paletteBuffer.EndFrame();
+}
 
-    // Pass Bone Matrices Array
-    GLint boneLoc = glGetUniformLocation(shader, "boneMatrices");
-    glUniformMatrix4fv(boneLoc, skinningMatrices.size(), GL_FALSE, &skinningMatrices[0][0][0]);
+void Skin::SkinVertices(const GLuint shaders[NumInfluenceClasses], GLuint outputBuffer) {
+    const GLsizeiptr vertexBytes = 2 * sizeof(glm::vec3);
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
-}
\ No newline at end of file
+    paletteBuffer.BeginFrame();
+    int boneBase = UploadPalette();
+    if (boneBase >= 0) {
+        paletteBuffer.Bind(0);
+
+        BoundState::BindVertexArray(VAO);
+        for (int c = 0; c < 4; c++) {
+            glm::vec4 column(0.0f);
+            column[c] = 1.0f;
+            glVertexAttrib4fv(6 + c, &column[0]);
+        }
+        glVertexAttrib4f(4, 0.0f, 0.0f, 0.0f, 0.0f);
+        glVertexAttribI4ui(5, 0, 0, 0, 0);
+
+        // The program can't change while capturing, so each influence range
+        // is its own capture into its slice of the output
+        glEnable(GL_RASTERIZER_DISCARD);
+        for (int c = 0; c < NumInfluenceClasses; c++) {
+            int count = classEndVertex[c] - classFirstVertex[c];
+            if (count == 0) continue;
+
+            SetSkinningUniforms(shaders[c], glm::mat4(1.0f), boneBase);
+            bool extra = c == NumInfluenceClasses - 1 && numExtraVertices > 0;
+            if (extra) {
+                glEnableVertexAttribArray(4);
+                glEnableVertexAttribArray(5);
+            }
+            glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, outputBuffer, classFirstVertex[c] * vertexBytes,
+                count * vertexBytes);
+            glBeginTransformFeedback(GL_POINTS);
+            glDrawArrays(GL_POINTS, classFirstVertex[c], count);
+            glEndTransformFeedback();
+            if (extra) {
+                glDisableVertexAttribArray(4);
+                glDisableVertexAttribArray(5);
+            }
+        }
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glDisable(GL_RASTERIZER_DISCARD);
+        BoundState::BindVertexArray(0);
+    }
+    paletteBuffer.EndFrame();
+    BoundState::UseProgram(0);
+}
+
+void Skin::DrawIndexed(int level) const {
+    const LodLevel& lod = lods[level];
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    glDrawElements(GL_TRIANGLES, (GLsizei)lod.indices.size(), indexType, (void*)(lod.firstIndex * indexSize));
+}
+
+int Skin::GetDrawLod(const glm::mat4& viewProjMtx) const {
+    if (lods.empty()) return 0;
+    return forcedLod >= 0 ? std::min(forcedLod, (int)lods.size() - 1) : SelectLod(viewProjMtx);
+}
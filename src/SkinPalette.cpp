@@ -0,0 +1,42 @@
+#include "SkinPalette.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SKIN_PALETTE_SSE 1
+#include <emmintrin.h>
+#endif
+
+#ifdef SKIN_PALETTE_SSE
+
+void BuildSkinPalette(const glm::mat4* world, const glm::mat4* inverseBind, int count, glm::mat4* palette) {
+    for (int i = 0; i < count; i++) {
+        const float* a = &world[i][0][0];
+        const float* b = &inverseBind[i][0][0];
+        float* out = &palette[i][0][0];
+
+        // Column-major: out.col[c] = sum_k a.col[k] * b[c][k], a separate
+        // multiply and add per term (SSE2 has no FMA)
+        __m128 a0 = _mm_loadu_ps(a + 0);
+        __m128 a1 = _mm_loadu_ps(a + 4);
+        __m128 a2 = _mm_loadu_ps(a + 8);
+        __m128 a3 = _mm_loadu_ps(a + 12);
+
+        for (int c = 0; c < 4; c++) {
+            const float* bc = b + 4 * c;
+            __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+            r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+            r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+            r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+            _mm_storeu_ps(out + 4 * c, r);
+        }
+    }
+}
+
+#else
+
+void BuildSkinPalette(const glm::mat4* world, const glm::mat4* inverseBind, int count, glm::mat4* palette) {
+    for (int i = 0; i < count; i++) {
+        palette[i] = world[i] * inverseBind[i];
+    }
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include "SkinnedVertexCache.h"
+#include "Shader.h"
+#include "ShaderProgram.h"
+#include <algorithm>
+
+SkinnedVertexCache::SkinnedVertexCache() {
+    skin = nullptr;
+    for (GLuint& program : programs) program = 0;
+    buffer = 0;
+    VAO = 0;
+    valid = false;
+    version = 0;
+    numSkinned = 0;
+}
+
+SkinnedVertexCache::~SkinnedVertexCache() {
+    Destroy();
+}
+
+void SkinnedVertexCache::Destroy() {
+    for (GLuint& program : programs) {
+        glDeleteProgram(program);
+        program = 0;
+    }
+    glDeleteBuffers(1, &buffer);
+    BoundState::DeleteVertexArray(VAO);
+    buffer = 0;
+    VAO = 0;
+    valid = false;
+}
+
+bool SkinnedVertexCache::Create(Skin* skin) {
+    Destroy();
+    this->skin = skin;
+
+    // skin.vert's variants, capturing what it hands the fragment shader
+    const char* varyings[] = { "FragPos", "FragNormal" };
+    const char* defines[Skin::NumInfluenceClasses] = {
+        "#define MAX_INFLUENCES 1\n", "#define MAX_INFLUENCES 2\n",
+        "#define MAX_INFLUENCES 4\n", "#define MAX_INFLUENCES 8\n" };
+    for (int c = 0; c < Skin::NumInfluenceClasses; c++) {
+        programs[c] = RequestTransformFeedbackShader("shaders/skin.vert", varyings, 2, defines[c]);
+    }
+    if (!FinishShaders()) {
+        Destroy();
+        return false;
+    }
+
+    // Position (Loc 0) and normal (Loc 1), interleaved as captured
+    GLsizei stride = 2 * sizeof(glm::vec3);
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &buffer);
+    BoundState::BindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)skin->GetNumVertices() * stride, nullptr, GL_DYNAMIC_COPY);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skin->GetIndexBuffer());
+    BoundState::BindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+bool SkinnedVertexCache::Update() {
+    if (!VAO) return false;
+    if (valid && version == skin->GetPaletteVersion()) return false;
+
+    skin->SkinVertices(programs, buffer);
+    version = skin->GetPaletteVersion();
+    valid = true;
+    numSkinned++;
+    return true;
+}
+
+void SkinnedVertexCache::ReadBack(std::vector<glm::vec3>& vertices) const {
+    vertices.resize(2 * (size_t)skin->GetNumVertices());
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(glm::vec3), vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SkinnedVertexCache::ComparePaletteFormat(Skin::PaletteFormat format, bool rigid, float& positionError,
+    float& normalError) {
+    positionError = normalError = 0.0f;
+    if (!VAO) return;
+    Skin::PaletteFormat oldFormat = skin->GetPaletteFormat();
+    bool oldRigid = skin->GetRigidBones();
+
+    std::vector<glm::vec3> reference, tested;
+    skin->SetPaletteFormat(Skin::PaletteMatrix4x4);
+    skin->SetRigidBones(false);
+    skin->SkinVertices(programs, buffer);
+    ReadBack(reference);
+
+    skin->SetPaletteFormat(format);
+    skin->SetRigidBones(rigid);
+    skin->SkinVertices(programs, buffer);
+    ReadBack(tested);
+
+    skin->SetPaletteFormat(oldFormat);
+    skin->SetRigidBones(oldRigid);
+    valid = false;
+
+    for (size_t i = 0; i < reference.size(); i += 2) {
+        positionError = std::max(positionError, glm::length(tested[i] - reference[i]));
+        normalError = std::max(normalError, glm::length(tested[i + 1] - reference[i + 1]));
+    }
+    positionError /= std::max(skin->GetBoundRadius(), 1e-6f);
+}
+
+void SkinnedVertexCache::Draw(const glm::mat4& viewProjMtx, GLuint shader) {
+    if (!valid || skin->GetNumLods() == 0) return;
+
+    const ShaderProgram& program = ShaderProgram::Get(shader);
+    program.Use();
+    glUniformMatrix4fv(program.GetLocation(ShaderProgram::ViewProj), 1, GL_FALSE, &viewProjMtx[0][0]);
+    BoundState::BindVertexArray(VAO);
+    skin->DrawIndexed(skin->GetDrawLod(viewProjMtx));
+    BoundState::BindVertexArray(0);
+    BoundState::UseProgram(0);
+}
+
+void SkinnedVertexCache::Submit(RenderQueue& queue, GLuint shader) const {
+    if (!valid || skin->GetNumLods() == 0) return;
+
+    RenderQueue::Packet packet;
+    packet.program = shader;
+    packet.vertexArray = VAO;
+    packet.draw = &SkinnedVertexCache::DrawPacket;
+    packet.object = this;
+    packet.args.x = skin->GetDrawLod(queue.GetViewProj());
+    queue.Submit(RenderQueue::MakeKey(RenderQueue::Opaque, shader, VAO), packet);
+}
+
+void SkinnedVertexCache::DrawPacket(const RenderQueue::Packet& packet) {
+    ((const SkinnedVertexCache*)packet.object)->skin->DrawIndexed(packet.args.x);
+}
@@ -0,0 +1,88 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int numThreads) {
+    if (numThreads <= 0) {
+        numThreads = (int)std::thread::hardware_concurrency();
+        if (numThreads <= 0) numThreads = 1;
+    }
+    for (int i = 1; i < numThreads; i++) {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+ThreadPool& ThreadPool::Get() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::RunJob(const std::function<void(int)>& fn, int count) {
+    while (true) {
+        int i = nextIndex.fetch_add(1, std::memory_order_relaxed);
+        if (i >= count) break;
+        fn(i);
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    int seen = 0;
+    while (true) {
+        const std::function<void(int)>* fn;
+        int count;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+            fn = job;
+            count = jobCount;
+        }
+
+        RunJob(*fn, count);
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            last = ++finishedWorkers == (int)workers.size();
+        }
+        if (last) done.notify_one();
+    }
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& fn) {
+    if (count <= 0) return;
+
+    // Nothing to share: skip the handshake entirely
+    if (workers.empty() || count == 1) {
+        for (int i = 0; i < count; i++) fn(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        jobCount = count;
+        nextIndex.store(0, std::memory_order_relaxed);
+        finishedWorkers = 0;
+        generation++;
+    }
+    wake.notify_all();
+
+    // The calling thread works too
+    RunJob(fn, count);
+
+    // Every worker has to check in before fn can go out of scope
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return finishedWorkers == (int)workers.size(); });
+    job = nullptr;
+}
@@ -0,0 +1,163 @@
+#include "VertexAnimationTexture.h"
+#include "CpuSkinner.h"
+#include "SkinPalette.h"
+#include "ShaderProgram.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Frames are wrapped into rows this wide (well under any GL_MAX_TEXTURE_SIZE)
+const int TextureWidth = 4096;
+
+// Unit normal as signed normalized 10-10-10-2, same layout as Skin's
+GLuint PackNormal(float x, float y, float z) {
+    GLuint px = (GLuint)(int)std::lround(glm::clamp(x, -1.0f, 1.0f) * 511.0f) & 0x3FF;
+    GLuint py = (GLuint)(int)std::lround(glm::clamp(y, -1.0f, 1.0f) * 511.0f) & 0x3FF;
+    GLuint pz = (GLuint)(int)std::lround(glm::clamp(z, -1.0f, 1.0f) * 511.0f) & 0x3FF;
+    return px | (py << 10) | (pz << 20);
+}
+
+GLuint FloatBits(float f) {
+    GLuint bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+}
+
+VertexAnimationTexture::VertexAnimationTexture() {
+    numVertices = 0;
+    numFrames = 0;
+    frameRate = 30.0f;
+    texture = 0;
+    VAO = 0;
+    EBO = 0;
+    indexType = GL_UNSIGNED_INT;
+}
+
+VertexAnimationTexture::~VertexAnimationTexture() {
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &EBO);
+    BoundState::DeleteVertexArray(VAO);
+}
+
+bool VertexAnimationTexture::Bake(const Skin& skin, const SkeletonDefinition& def, const Animation& animation,
+    const AnimationBinding& binding, float frameRate) {
+    this->frameRate = std::max(frameRate, 1.0f);
+    float start = animation.GetStartTime();
+    float length = animation.GetEndTime() - start;
+    numFrames = std::max(1, (int)std::ceil(length * this->frameRate));
+    numVertices = skin.GetNumVertices();
+
+    long long totalTexels = (long long)numFrames * numVertices;
+    int height = (int)((totalTexels + TextureWidth - 1) / TextureWidth);
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (numVertices == 0 || height > maxSize) {
+        std::cerr << "VertexAnimationTexture: " << numFrames << " frames of " << numVertices
+                  << " vertices do not fit in a texture" << std::endl;
+        return false;
+    }
+
+    // Pose, palette and skin every frame on the CPU
+    SkeletonInstance instance(&def);
+    CpuSkinner skinner;
+    skinner.Prepare(skin);
+    SkinnedVertices skinned;
+    const std::vector<glm::mat4>& inverseBindings = skin.GetInverseBindings();
+    std::vector<glm::mat4> palette(inverseBindings.size(), glm::mat4(1.0f));
+    std::vector<glm::uvec4> texels((size_t)height * TextureWidth, glm::uvec4(0));
+
+    for (int f = 0; f < numFrames; f++) {
+        animation.Sample(start + f / this->frameRate, binding, instance.GetPose());
+        instance.Update();
+        const std::vector<glm::mat4>& world = instance.GetWorldMatrices();
+        BuildSkinPalette(world.data(), inverseBindings.data(), (int)std::min(world.size(), palette.size()), palette.data());
+        skinner.Deform(palette.data(), skinned);
+
+        glm::uvec4* frame = &texels[(size_t)f * numVertices];
+        for (int v = 0; v < numVertices; v++) {
+            frame[v] = glm::uvec4(FloatBits(skinned.px[v]), FloatBits(skinned.py[v]), FloatBits(skinned.pz[v]),
+                PackNormal(skinned.nx[v], skinned.ny[v], skinned.nz[v]));
+        }
+    }
+
+    if (!texture) glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, TextureWidth, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, texels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Every LOD's indices back to back, as in Skin. No vertex arrays: the
+    // shader reads everything through gl_VertexID.
+    std::vector<unsigned int> allIndices;
+    lodFirstIndex.clear();
+    lodIndexCount.clear();
+    for (int level = 0; level < skin.GetNumLods(); level++) {
+        const std::vector<unsigned int>& indices = skin.GetLodIndices(level);
+        lodFirstIndex.push_back((int)allIndices.size());
+        lodIndexCount.push_back((int)indices.size());
+        allIndices.insert(allIndices.end(), indices.begin(), indices.end());
+    }
+
+    if (!VAO) glGenVertexArrays(1, &VAO);
+    if (!EBO) glGenBuffers(1, &EBO);
+    BoundState::BindVertexArray(VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    if (numVertices <= 65536) {
+        std::vector<unsigned short> shortIndices(allIndices.begin(), allIndices.end());
+        indexType = GL_UNSIGNED_SHORT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+    }
+    else {
+        indexType = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, allIndices.size() * sizeof(unsigned int), allIndices.data(), GL_STATIC_DRAW);
+    }
+    BoundState::BindVertexArray(0);
+    return true;
+}
+
+void VertexAnimationTexture::DrawInstanced(const glm::mat4& viewProjMtx, GLuint shader, int level, float time,
+    GLuint modelBuffer, GLuint offsetBuffer, int firstInstance, int count) const {
+    if (count <= 0 || !texture) return;
+    level = std::min(level, GetNumLods() - 1);
+
+    const ShaderProgram& program = ShaderProgram::Get(shader);
+    program.Use();
+    glUniformMatrix4fv(program.GetLocation(ShaderProgram::ViewProj), 1, GL_FALSE, &viewProjMtx[0][0]);
+    glUniform1i(program.FindLocation("vatTexture"), 0);
+    glUniform1i(program.FindLocation("numVertices"), numVertices);
+    glUniform1i(program.FindLocation("numFrames"), numFrames);
+    glUniform1f(program.FindLocation("frameRate"), frameRate);
+    glUniform1f(program.FindLocation("time"), time);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    BoundState::BindVertexArray(VAO);
+    // Model matrix (Loc 6-9) and time offset (Loc 10), per instance
+    glBindBuffer(GL_ARRAY_BUFFER, modelBuffer);
+    for (int c = 0; c < 4; c++) {
+        glEnableVertexAttribArray(6 + c);
+        glVertexAttribPointer(6 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+            (void*)(firstInstance * sizeof(glm::mat4) + c * sizeof(glm::vec4)));
+        glVertexAttribDivisor(6 + c, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, offsetBuffer);
+    glEnableVertexAttribArray(10);
+    glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)(firstInstance * sizeof(float)));
+    glVertexAttribDivisor(10, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    glDrawElementsInstanced(GL_TRIANGLES, lodIndexCount[level], indexType,
+        (void*)(lodFirstIndex[level] * indexSize), count);
+
+    BoundState::BindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    BoundState::UseProgram(0);
+}
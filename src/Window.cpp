@@ -3,6 +3,10 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include "skin.h"
+#include "SkinPalette.h"
+#include <chrono>
+#include <functional>
+#include <random>
 
 int selectedJointIdx = 0;
 int selectedDOF = 0; // 0 for X, 1 for Y, 2 for Z
@@ -14,10 +18,22 @@ const char* Window::windowTitle = "CSE 169 Project 1";
 
 
 Skin* Window::skin = nullptr;
+SkinnedVertexCache* Window::skinCache = nullptr;
+DebugDraw* Window::debugDraw = nullptr;
+Crowd* Window::crowd = nullptr;
+int Window::crowdSize = 0;
+VertexAnimationTexture* Window::crowdClip = nullptr;
+GpuAnimator* Window::crowdAnimator = nullptr;
+bool Window::gpuAnimation = false;
+bool Window::useSkinCache = false;
+bool Window::crowdUpdateLod = true;
+double crowdUpdateTime = 0.0; // CPU seconds in the last Crowd::Update
+RenderQueue Window::renderQueue;
 
 // Objects to render
 Cube* Window::cube;
-Skeleton* Window::skeleton = nullptr;
+SkeletonDefinition* Window::skeletonDef = nullptr;
+SkeletonInstance* Window::skeleton = nullptr;
 
 // Camera Properties
 Camera* Cam;
@@ -28,15 +44,28 @@ int MouseX, MouseY;
 
 // The shader program id
 GLuint Window::shaderProgram;
-GLuint Window::skinShaderProgram;
+GLuint Window::skinShaderPrograms[Skin::NumInfluenceClasses];
+GLuint Window::vatShaderProgram;
+GLuint Window::skinnedShaderProgram;
+GLuint Window::debugShaderProgram;
 // Constructors and desctructors
 bool Window::initializeProgram() {
     // Create a shader program with a vertex shader and a fragment shader.
+    // All of them are requested before any is checked, so they compile
+    // together (or come straight from the program cache).
     PrintInstructions();
-    shaderProgram = LoadShaders("shaders/shader.vert", "shaders/shader.frag");
-    skinShaderProgram = LoadShaders("shaders/skin.vert", "shaders/skin.frag");
-    // Check the shader program.
-    if (!shaderProgram) {
+    shaderProgram = RequestShaders("shaders/shader.vert", "shaders/shader.frag");
+    const char* skinVariants[Skin::NumInfluenceClasses] = {
+        "#define MAX_INFLUENCES 1\n", "#define MAX_INFLUENCES 2\n",
+        "#define MAX_INFLUENCES 4\n", "#define MAX_INFLUENCES 8\n" };
+    for (int i = 0; i < Skin::NumInfluenceClasses; i++) {
+        skinShaderPrograms[i] = RequestShaders("shaders/skin.vert", "shaders/skin.frag", skinVariants[i]);
+    }
+    vatShaderProgram = RequestShaders("shaders/vat.vert", "shaders/skin.frag");
+    skinnedShaderProgram = RequestShaders("shaders/skinned.vert", "shaders/skin.frag");
+    debugShaderProgram = RequestShaders("shaders/debug.vert", "shaders/debug.frag");
+    // Check the shader programs.
+    if (!FinishShaders()) {
         std::cerr << "Failed to initialize shader program" << std::endl;
         return false;
     }
@@ -53,35 +82,63 @@ bool Window::initializeObjects() {
     // Create a cube
     cube = new Cube();
     // cube = new Cube(glm::vec3(-1, 0, -2), glm::vec3(1, 1, 1));
+    debugDraw = new DebugDraw();
     return true;
 }
 
 void Window::cleanUp() {
     // Deallcoate the objects.
     delete cube;
+    delete debugDraw;
+    if (crowd) delete crowd;
+    if (crowdClip) delete crowdClip;
+    if (crowdAnimator) delete crowdAnimator;
+    if (skinCache) delete skinCache;
     if (skeleton) delete skeleton;
+    if (skeletonDef) delete skeletonDef;
     if (animation) delete animation;
 
     // Delete the shader program.
     glDeleteProgram(shaderProgram);
+    for (GLuint program : skinShaderPrograms) glDeleteProgram(program);
+    glDeleteProgram(vatShaderProgram);
+    glDeleteProgram(skinnedShaderProgram);
+    glDeleteProgram(debugShaderProgram);
 }
 
 // Initializing static members
 Animation* Window::animation = nullptr;
+AnimationBinding Window::animationBinding;
 float Window::time = 0.0f;
 bool Window::isPlaying = true;
 
 std::string Window::lastLoadedFile = "";
 void Window::LoadSkeleton(const char* filename) {
     std::string fn(filename);
+    // The crowd (and its baked clip) is rebuilt on the next frame
+    if (crowd) delete crowd;
+    if (crowdClip) delete crowdClip;
+    if (crowdAnimator) delete crowdAnimator;
+    crowd = nullptr;
+    crowdClip = nullptr;
+    crowdAnimator = nullptr;
     if(fn.find(".skel") != std::string::npos) {
         if (skeleton) delete skeleton;
-        skeleton = new Skeleton();
-        if (!skeleton->Load(filename)) {
+        if (skeletonDef) delete skeletonDef;
+        skeleton = nullptr;
+        skeletonDef = new SkeletonDefinition();
+        // DebugDraw shares one box mesh, so no per-joint geometry
+        if (!skeletonDef->Load(filename, false)) {
             std::cerr << "Failed to load skeleton: " << filename << std::endl;
+        } else {
+            skeleton = new SkeletonInstance(skeletonDef);
+            selectedJointIdx = 0;
+            BindAnimation();
         }
     } 
     else if(fn.find(".skin") != std::string::npos) {
+        if (skinCache) delete skinCache;
+        skinCache = nullptr;
         if (skin) delete skin;
         skin = new Skin();
         if (!skin->Load(filename)) {
@@ -95,10 +152,112 @@ void Window::LoadSkeleton(const char* filename) {
             std::cerr << "Failed to load animation: " << filename << std::endl;
         } else {
              time = animation->GetStartTime();
+             BindAnimation();
         }
     }
 }
 
+void Window::BindAnimation() {
+    if (animation && skeletonDef) {
+        animation->Bind(*skeletonDef, animationBinding);
+    }
+}
+
+bool Window::CheckPaletteFormats() {
+    if (!skin) {
+        std::cerr << "--check-palette needs a skin" << std::endl;
+        return false;
+    }
+    SkinnedVertexCache check;
+    if (!check.Create(skin)) return false;
+
+    // 3x4 stores the same rows as 4x4, so it must match up to rounding. Dual
+    // quaternions blend differently from matrices wherever a vertex has
+    // several bones: positions stay close, but a normal on a 50/50 bend
+    // can tilt by ~15 degrees, so that bound is loose.
+    struct Case { const char* name; Skin::PaletteFormat format; bool rigid; float maxPosition, maxNormal; };
+    const Case cases[] = {
+        { "3x4", Skin::PaletteAffine3x4, false, 1e-5f, 1e-4f },
+        { "3x4 rigid", Skin::PaletteAffine3x4, true, 1e-5f, 1e-4f },
+        { "dual quaternion", Skin::PaletteDualQuaternion, true, 0.02f, 0.5f },
+    };
+
+    bool passed = true;
+    for (int k = 0; k < 3; k++) {
+        // Three poses across the clip, or the bind pose without one
+        if (animation && skeleton) {
+            float length = animation->GetEndTime() - animation->GetStartTime();
+            animation->Sample(animation->GetStartTime() + (k + 0.5f) / 3.0f * length, animationBinding, skeleton->GetPose());
+            skeleton->Update();
+            skin->Update(skeleton);
+        } else {
+            skin->Update((SkeletonInstance*)nullptr);
+        }
+        for (const Case& c : cases) {
+            float positionError, normalError;
+            check.ComparePaletteFormat(c.format, c.rigid, positionError, normalError);
+            bool ok = positionError <= c.maxPosition && normalError <= c.maxNormal;
+            passed = passed && ok;
+            std::cout << "Palette " << c.name << ", pose " << k << ": position " << positionError << " of radius, normal "
+                      << normalError << (ok ? " ok" : " FAILED") << std::endl;
+        }
+    }
+    return passed;
+}
+
+bool Window::BenchPalette() {
+    std::mt19937 rng(169);
+    std::uniform_real_distribution<float> angle(-3.14159f, 3.14159f), offset(-1.0f, 1.0f);
+    auto randomRigid = [&]() {
+        glm::mat4 m = glm::translate(glm::vec3(offset(rng), offset(rng), offset(rng)));
+        m = glm::rotate(m, angle(rng), glm::vec3(0, 0, 1));
+        m = glm::rotate(m, angle(rng), glm::vec3(0, 1, 0));
+        return glm::rotate(m, angle(rng), glm::vec3(1, 0, 0));
+    };
+
+    bool passed = true;
+    for (int numJoints : { 1000, 10000 }) {
+        std::vector<glm::mat4> world(numJoints), bindings(numJoints), inverseBindings(numJoints);
+        std::vector<glm::mat4> before(numJoints), after(numJoints);
+        for (int i = 0; i < numJoints; i++) {
+            world[i] = randomRigid();
+            bindings[i] = randomRigid();
+            inverseBindings[i] = glm::inverse(bindings[i]);
+        }
+
+        // Best of 5 runs, each about 2M joints
+        int repeats = 2000000 / numJoints;
+        auto bestTime = [&](const std::function<void()>& build) {
+            double best = 1e30;
+            for (int run = 0; run < 5; run++) {
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < repeats; r++) build();
+                std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+                best = std::min(best, elapsed.count() / repeats);
+            }
+            return best;
+        };
+        double oldTime = bestTime([&]() {
+            for (int i = 0; i < numJoints; i++) before[i] = world[i] * glm::inverse(bindings[i]);
+        });
+        double newTime = bestTime([&]() {
+            BuildSkinPalette(world.data(), inverseBindings.data(), numJoints, after.data());
+        });
+
+        // Same product as the scalar path with cached inverses, up to rounding
+        float maxError = 0.0f;
+        for (int i = 0; i < numJoints; i++) {
+            glm::mat4 expected = world[i] * inverseBindings[i];
+            for (int c = 0; c < 4; c++) maxError = std::max(maxError, glm::length(after[i][c] - expected[c]));
+        }
+        bool ok = maxError <= 1e-5f;
+        passed = passed && ok;
+        std::cout << "Palette " << numJoints << " joints: inverse per joint " << oldTime << " us, BuildSkinPalette "
+                  << newTime << " us, max difference " << maxError << (ok ? " ok" : " FAILED") << std::endl;
+    }
+    return passed;
+}
+
 // for the Window
 GLFWwindow* Window::createWindow(int width, int height) {
     // Initialize GLFW.
@@ -163,34 +322,34 @@ void Window::idleCallback() {
 
 // Helper function to recursively draw Joint UI
 // Local helper function in Window.cpp
-void DrawJointUI(Joint* joint) {
-    if (!joint) return;
+void DrawJointUI(SkeletonInstance* skeleton, int joint) {
+    const SkeletonDefinition* def = skeleton->GetDefinition();
 
     // Create a unique ID for ImGui to handle joints with the same name
     ImGui::PushID(joint);
 
     // Use a tree node for the hierarchy
-    if (ImGui::TreeNode(joint->GetName().c_str())) {
-        float* posePtr = joint->GetPosePtr();
+    if (ImGui::TreeNode(def->GetName(joint).c_str())) {
+        float* posePtr = skeleton->GetPosePtr(joint);
         
         // Retrieve limits (which are parsed from the .skel file)
-        glm::vec2 limX = joint->GetRotXLimit();
-        glm::vec2 limY = joint->GetRotYLimit();
-        glm::vec2 limZ = joint->GetRotZLimit();
+        glm::vec2 limX(def->GetLimitMin(joint).x, def->GetLimitMax(joint).x);
+        glm::vec2 limY(def->GetLimitMin(joint).y, def->GetLimitMax(joint).y);
+        glm::vec2 limZ(def->GetLimitMin(joint).z, def->GetLimitMax(joint).z);
 
         // SliderAngle: user sees Degrees, variable stores Radians
         if (ImGui::SliderAngle("Rotate X", &posePtr[0], glm::degrees(limX.x), glm::degrees(limX.y))) {
-            printf("Joint: %s | DOF: Rotate X | Value: %.3f degrees\n", joint->GetName().c_str(), glm::degrees(posePtr[0]));
+            printf("Joint: %s | DOF: Rotate X | Value: %.3f degrees\n", def->GetName(joint).c_str(), glm::degrees(posePtr[0]));
         }
         if (ImGui::SliderAngle("Rotate Y", &posePtr[1], glm::degrees(limY.x), glm::degrees(limY.y))) {
-            printf("Joint: %s | DOF: Rotate Y | Value: %.3f degrees\n", joint->GetName().c_str(), glm::degrees(posePtr[1]));
+            printf("Joint: %s | DOF: Rotate Y | Value: %.3f degrees\n", def->GetName(joint).c_str(), glm::degrees(posePtr[1]));
         }
         if (ImGui::SliderAngle("Rotate Z", &posePtr[2], glm::degrees(limZ.x), glm::degrees(limZ.y))) {
-            printf("Joint: %s | DOF: Rotate Z | Value: %.3f degrees\n", joint->GetName().c_str(), glm::degrees(posePtr[2]));
+            printf("Joint: %s | DOF: Rotate Z | Value: %.3f degrees\n", def->GetName(joint).c_str(), glm::degrees(posePtr[2]));
         }
         // Recursively draw children
-        for (Joint* child : joint->GetChildren()) {
-            DrawJointUI(child);
+        for (int child : def->GetChildren(joint)) {
+            DrawJointUI(skeleton, child);
         }
 
         ImGui::TreePop();
@@ -205,21 +364,76 @@ void Window::displayCallback(GLFWwindow* window) {
 
     // Render the object.
     // cube->draw(Camera::getViewProjMtx(), Window::shaderProgram);
-    if (skin && skeleton) {
+    renderQueue.SetViewProj(Cam->GetViewProjectMtx());
+    if (crowdSize > 0 && skin && skeletonDef && !crowd) {
+        // Spaced so neighbours' bounding spheres don't touch
+        crowd = new Crowd(skin, skeletonDef);
+        crowd->SpawnGrid(crowdSize, 2.5f * skin->GetBoundRadius());
+        // The two coarsest levels play the clip baked at 30 fps instead
+        if (animation && skin->GetNumLods() > 1) {
+            crowdClip = new VertexAnimationTexture();
+            if (crowdClip->Bake(*skin, *skeletonDef, *animation, animationBinding, 30.0f)) {
+                crowd->SetVertexAnimation(crowdClip, vatShaderProgram, std::max(1, skin->GetNumLods() - 2));
+            }
+        }
+        if (animation && gpuAnimation) {
+            crowdAnimator = new GpuAnimator();
+            if (crowdAnimator->Load(*animation, animationBinding, *skeletonDef, *skin)) {
+                crowd->SetGpuAnimator(crowdAnimator);
+            }
+        }
+    }
+    if (crowd) {
+        // Full rate within 20 character radii, then every 2nd/4th/8th frame
+        crowd->SetUpdateRates(crowdUpdateLod ? 20.0f * skin->GetBoundRadius() : 0.0f);
+        double updateStart = glfwGetTime();
+        crowd->Update(animation, animationBinding, time);
+        crowdUpdateTime = glfwGetTime() - updateStart;
+        crowd->Draw(Cam->GetViewProjectMtx(), Window::skinShaderPrograms);
+
+        // A marker on the selected joint of the middle character, placed the
+        // way an attachment would be
+        if (crowd->GetNumInstances() > 0 && selectedJointIdx < skeletonDef->GetNumJoints()) {
+            glm::mat4 joint = crowd->EvaluateJoint(crowd->GetNumInstances() / 2, selectedJointIdx);
+            cube->setModel(joint * glm::scale(glm::vec3(0.05f * skin->GetBoundRadius())));
+            cube->submit(renderQueue, Window::shaderProgram);
+        }
+    }
+    else if (skin && skeleton) {
         // Compute matrices based on current skeleton pose
         skin->Update(skeleton);
-        
+
+        // The cache skins once per pose change for any number of passes, but
+        // with only the main view that's an extra pass over the vertices, so
+        // the palette path stays the default
+        if (useSkinCache && !skinCache) {
+            skinCache = new SkinnedVertexCache();
+            skinCache->Create(skin);
+        }
+
         // Draw Mesh
-        skeleton->Draw(Cam->GetViewProjectMtx(), Window::shaderProgram);
-        skin->Draw(Cam->GetViewProjectMtx(), Window::skinShaderProgram);
+        debugDraw->AddSkeleton(*skeleton);
+        debugDraw->Submit(renderQueue, Window::debugShaderProgram);
+        if (useSkinCache && skinCache->IsCreated()) {
+            // Off-screen: don't even re-skin; Update catches up once visible
+            if (!skin->IsCulled(Cam->GetViewProjectMtx())) {
+                skinCache->Update();
+                skinCache->Submit(renderQueue, Window::skinnedShaderProgram);
+            }
+        }
+        else skin->Submit(renderQueue, Window::skinShaderPrograms);
+    }
+    else if (skeleton) {
+        debugDraw->AddSkeleton(*skeleton);
+        debugDraw->Submit(renderQueue, Window::debugShaderProgram);
     }
-    else if (skeleton) skeleton->Draw(Cam->GetViewProjectMtx(), Window::shaderProgram);
 
     else if (skin) {
     // Draw skin in bind pose if no skeleton is loaded
-        skin->Update(nullptr);
-        skin->Draw(Cam->GetViewProjectMtx(), Window::skinShaderProgram);
+        skin->Update((SkeletonInstance*)nullptr);
+        skin->Submit(renderQueue, Window::skinShaderPrograms);
     }
+    renderQueue.Execute();
     
     // Animation Update
     if (animation && skeleton) {
@@ -238,7 +452,7 @@ void Window::displayCallback(GLFWwindow* window) {
              lastTime = glfwGetTime();
         }
         
-        animation->Evaluate(time, skeleton);
+        animation->Sample(time, animationBinding, skeleton->GetPose());
     }
 
 
@@ -259,11 +473,21 @@ void Window::displayCallback(GLFWwindow* window) {
     } else {
          ImGui::Text("No animation loaded");
     }
+    const RenderQueue::Stats& drawStats = renderQueue.GetStats();
+    ImGui::Text("Draws: %d, program changes: %d (unsorted %d), VAO changes: %d (unsorted %d)", drawStats.packets,
+        drawStats.programChanges, drawStats.unsortedProgramChanges, drawStats.vertexArrayChanges,
+        drawStats.unsortedVertexArrayChanges);
+    if (crowd) {
+        ImGui::Text("Crowd: %d characters, %d culled, %d baked, %d draws", crowd->GetNumInstances(),
+            crowd->GetNumCulled(), crowd->GetNumBaked(), crowd->GetNumBatches());
+        ImGui::Checkbox("Animation update LOD", &crowdUpdateLod);
+        ImGui::Text("Animation update: %.2f ms, %d skeletons", 1000.0 * crowdUpdateTime, crowd->GetNumAnimated());
+    }
     ImGui::End();
 
     ImGui::Begin("Skeleton Editor");
-    if (Window::skeleton && Window::skeleton->GetRoot()) {
-        DrawJointUI(Window::skeleton->GetRoot());
+    if (Window::skeleton && Window::skeleton->GetNumJoints() > 0) {
+        DrawJointUI(Window::skeleton, 0);
     } else {
         ImGui::Text("No skeleton loaded.");
     }
@@ -298,8 +522,8 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
     // Check for a key press.
     if (action == GLFW_PRESS || action == GLFW_REPEAT) {
         
-        Joint* currentJoint = skeleton->jointList[selectedJointIdx];
-        float* posePtr = currentJoint->GetPosePtr();
+        int numJoints = skeleton ? skeleton->GetNumJoints() : 0;
+        float* posePtr = numJoints > 0 ? skeleton->GetPosePtr(selectedJointIdx) : nullptr;
 
         switch (key) {
             case GLFW_KEY_ESCAPE:
@@ -310,18 +534,27 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
             case GLFW_KEY_R:
                 resetCamera();
                 break;
+            case GLFW_KEY_B: {
+                // Boxes -> boxes + bones -> boxes + bones + axes (bits 1, 3, 7)
+                int parts = debugDraw->GetParts();
+                const int all = DebugDraw::Boxes | DebugDraw::Bones | DebugDraw::Axes;
+                debugDraw->SetParts(parts == all ? DebugDraw::Boxes : (parts << 1) | 1);
+                break;
+            }
             
             case GLFW_KEY_0:
                 // Refresh the skeleton by reloading the last file
                 if (!lastLoadedFile.empty()) {
                     LoadSkeleton(lastLoadedFile.c_str());
                 }
-                break;
+                return; // the old pose pointer is gone
             case GLFW_KEY_UP:
-                selectedJointIdx = (selectedJointIdx - 1 + skeleton->jointList.size()) % skeleton->jointList.size();
+                if (numJoints == 0) break;
+                selectedJointIdx = (selectedJointIdx - 1 + numJoints) % numJoints;
                 break;
             case GLFW_KEY_DOWN:
-                selectedJointIdx = (selectedJointIdx + 1) % skeleton->jointList.size();
+                if (numJoints == 0) break;
+                selectedJointIdx = (selectedJointIdx + 1) % numJoints;
                 break;
             case GLFW_KEY_LEFT:
                 selectedDOF = (selectedDOF - 1 + 3) % 3;
@@ -330,18 +563,20 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
                 selectedDOF = (selectedDOF + 1) % 3;
                 break;
             case GLFW_KEY_EQUAL: // The '+' key (without shift)
-                posePtr[selectedDOF] += 0.05f;
+                if (posePtr) posePtr[selectedDOF] += 0.05f;
                 break;
             case GLFW_KEY_MINUS:
-                posePtr[selectedDOF] -= 0.05f;
+                if (posePtr) posePtr[selectedDOF] -= 0.05f;
                 break;
 
             default:
                 break;
         }
+        if (numJoints == 0) return;
+        posePtr = skeleton->GetPosePtr(selectedJointIdx);
         const char* dofNames[] = {"Rotate X", "Rotate Y", "Rotate Z"};
         printf("Selected Joint: %s | DOF: %s | Value: %.3f degrees\n", 
-               currentJoint->GetName().c_str(), dofNames[selectedDOF], glm::degrees(posePtr[selectedDOF]));
+               skeletonDef->GetName(selectedJointIdx).c_str(), dofNames[selectedDOF], glm::degrees(posePtr[selectedDOF]));
     }
 }
 
@@ -395,6 +630,7 @@ void Window::PrintInstructions() {
     printf("  [-]                  : Decrease current DOF value\n");
     printf("\nCAMERA & SYSTEM:\n");
     printf("  [R]                  : Reset Camera position\n");
+    printf("  [B]                  : Show joint boxes / + bones / + axes\n");
     printf("  [0]                  : Reload the current skeleton/skin file\n");
     printf("  [ESC]                : Exit application\n");
     printf("--------------------------------------------------------------------------------\n");